@@ -1,7 +1,27 @@
 #include <iostream>
-#include "../Cobalt/src/tests/lexer_test.cpp"
+#include "src/h/daemon.h"
+#include "src/h/driver.h"
 
-int main() {
-    testLexer();
-    return 0;
+void testLexer();
+void testParser();
+
+// no arguments runs the built in tests, --daemon[=socket] serves
+// CobaltClient, otherwise compile the given file
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        testLexer();
+        testParser();
+        return 0;
+    }
+    if (const std::string arg = argv[1]; arg == "--daemon" || arg.rfind("--daemon=", 0) == 0) {
+        return cblt::daemon::serve(arg == "--daemon" ? cblt::daemon::defaultSocketPath() : arg.substr(9));
+    }
+
+    cblt::driver::Options opts;
+    std::string err;
+    if (!cblt::driver::parseArgs(argc, argv, opts, err)) {
+        std::cerr << err << '\n' << cblt::driver::usage();
+        return 1;
+    }
+    return cblt::driver::compile(opts, std::cerr);
 }
@@ -1,34 +1,1851 @@
 #include "h/ast.h"
 #include "h/cobalt.h"
+#include "h/debuginfo.h"
+#include "h/pgo.h"
+#include "h/sema.h"
+#include "runtime/map.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/Support/TimeProfiler.h"
+#include <set>
+#include <unordered_map>
 
 using namespace cblt::ast;
 using namespace cblt::globals;
 
+static llvm::Value *logErrorV(const std::string &msg, const int line) {
+    Errors.emplace_back("Codegen error: " + msg + ", line=" + std::to_string(line));
+    return nullptr;
+}
+
+// fnc values are {code, env}, closure code takes env as its first param.
+// every signature gets a struct type of its own, so a fnc value's type says
+// how to call it and passing one where another is expected doesn't convert
+static thread_local std::map<llvm::FunctionType *, llvm::StructType *> closureTypes;
+static thread_local std::map<const llvm::Type *, llvm::FunctionType *> closureSignatures;
+
+// sig is the code's, without the env
+static llvm::StructType *closureType(llvm::FunctionType *sig) {
+    if (const auto it = closureTypes.find(sig); it != closureTypes.end()) {
+        return it->second;
+    }
+    llvm::Type *i8Ptr = llvm::Type::getInt8PtrTy(Context);
+    llvm::StructType *ty = llvm::StructType::create(Context, {i8Ptr, i8Ptr}, "cblt.closure");
+    closureTypes[sig] = ty;
+    closureSignatures[ty] = sig;
+    return ty;
+}
+
+// what a value of ty is called with, null when ty isn't a fnc
+static llvm::FunctionType *closureSignature(const llvm::Type *ty) {
+    const auto it = closureSignatures.find(ty);
+    return it != closureSignatures.end() ? it->second : nullptr;
+}
+
+// []num -> {double *, len}, str -> {i8 *, len}. the data is constant, in a
+// region or on the runtime heap
+static llvm::StructType *arrayType() {
+    if (llvm::StructType *ty = llvm::StructType::getTypeByName(Context, "cblt.array")) {
+        return ty;
+    }
+    return llvm::StructType::create(
+        Context, {llvm::Type::getDoublePtrTy(Context), llvm::Type::getInt64Ty(Context)}, "cblt.array");
+}
+
+static llvm::StructType *strType() {
+    if (llvm::StructType *ty = llvm::StructType::getTypeByName(Context, "cblt.str")) {
+        return ty;
+    }
+    return llvm::StructType::create(
+        Context, {llvm::Type::getInt8PtrTy(Context), llvm::Type::getInt64Ty(Context)}, "cblt.str");
+}
+
+// {num:num} and {str:num} are pointers to a runtime map, see runtime/map.h
+static llvm::PointerType *mapType(const bool strKeys) {
+    const char *name = strKeys ? "cblt.strmap" : "cblt.nummap";
+    llvm::StructType *ty = llvm::StructType::getTypeByName(Context, name);
+    if (!ty) {
+        ty = llvm::StructType::create(Context, name);
+    }
+    return ty->getPointerTo();
+}
+
+// task is a pointer to a runtime Task, see runtime/tasks.cpp
+static llvm::PointerType *taskType() {
+    llvm::StructType *ty = llvm::StructType::getTypeByName(Context, "cblt.task");
+    if (!ty) {
+        ty = llvm::StructType::create(Context, "cblt.task");
+    }
+    return ty->getPointerTo();
+}
+
+// values that may point into a stack environment or a region
+static bool holdsPointer(const llvm::Type *ty) {
+    return closureSignature(ty) || ty == arrayType() || ty == strType();
+}
+
+static llvm::Type *typeFor(const std::string &type);
+
+// fnc(a, b) -> r as the parser spells it, nested fnc types included
+static llvm::Type *fncTypeFor(const std::string &type) {
+    std::vector<llvm::Type *> params;
+    int depth = 0;
+    size_t from = 4;
+    size_t at = from;
+    for (; at < type.size(); at++) {
+        const char c = type[at];
+        if (c == '(' || c == '{') {
+            depth++;
+        } else if ((c == ')' || c == '}') && depth > 0) {
+            depth--;
+        } else if (depth == 0 && (c == ',' || c == ')')) {
+            if (at > from) {
+                llvm::Type *param = typeFor(type.substr(from, at - from));
+                if (!param) {
+                    return nullptr;
+                }
+                params.push_back(param);
+            }
+            from = at + 2; // past ", "
+            if (c == ')') {
+                break;
+            }
+        }
+    }
+    if (type.compare(at, 5, ") -> ") != 0) {
+        return nullptr;
+    }
+    llvm::Type *ret = typeFor(type.substr(at + 5));
+    return ret ? closureType(llvm::FunctionType::get(ret, params, false)) : nullptr;
+}
+
+// num -> double, bool -> i1, fnc -> closure, str and []num -> slices. fnc
+// on its own is fnc(num) -> num
+static llvm::Type *typeFor(const std::string &type) {
+    if (type.empty() || type == "num") {
+        return llvm::Type::getDoubleTy(Context);
+    }
+    if (type == "bool") {
+        return llvm::Type::getInt1Ty(Context);
+    }
+    if (type == "fnc") {
+        llvm::Type *num = llvm::Type::getDoubleTy(Context);
+        return closureType(llvm::FunctionType::get(num, {num}, false));
+    }
+    if (type.rfind("fnc(", 0) == 0) {
+        return fncTypeFor(type);
+    }
+    if (type == "str") {
+        return strType();
+    }
+    if (type == "[]num") {
+        return arrayType();
+    }
+    if (type == "{num:num}" || type == "{str:num}") {
+        return mapType(type == "{str:num}");
+    }
+    if (type == "task") {
+        return taskType();
+    }
+    return nullptr;
+}
+
+// what statements and valueless ifs evaluate to
+static llvm::Value *noValue() {
+    return llvm::ConstantFP::get(Context, llvm::APFloat(0.0));
+}
+
+// implicit conversions between num, bool and main's i32 exit code
+static llvm::Value *convert(llvm::Value *v, llvm::Type *to) {
+    llvm::Type *from = v->getType();
+    if (from == to) {
+        return v;
+    }
+    if (from->isDoubleTy() && to->isIntegerTy(1)) {
+        return Builder->CreateFCmpONE(v, llvm::ConstantFP::get(Context, llvm::APFloat(0.0)), "tobool");
+    }
+    if (from->isIntegerTy(1) && to->isDoubleTy()) {
+        return Builder->CreateUIToFP(v, to, "tonum");
+    }
+    if (from->isDoubleTy() && to->isIntegerTy()) {
+        return Builder->CreateFPToSI(v, to, "toint");
+    }
+    if (from->isIntegerTy(1) && to->isIntegerTy()) {
+        return Builder->CreateZExt(v, to, "toint");
+    }
+    return nullptr;
+}
+
+static bool blockTerminated() {
+    return Builder->GetInsertBlock()->getTerminator() != nullptr;
+}
+
+// per fnc codegen state, the innermost fnc being generated is last
+struct FunctionState {
+    llvm::Function *fn;
+    llvm::BasicBlock *header; // self tail calls rebind the params and branch back here
+    std::vector<llvm::PHINode *> params;
+    llvm::Value *regionMark = nullptr; // set once the fnc allocates in its region
+    unsigned regionAllocs = 0; // lets loops tell whether an iteration allocated
+    std::vector<llvm::BranchInst *> backEdges; // self tail calls that may release the region
+    std::set<std::string> mutables; // names assigned somewhere in the body
+    // async fncs only, the Task the coroutine runs as, where its result goes
+    // and the blocks every return and suspend point branches to
+    llvm::Value *task = nullptr;
+    llvm::Value *out = nullptr;
+    llvm::Type *resultType = nullptr;
+    llvm::BasicBlock *coroFinal = nullptr;
+    llvm::BasicBlock *coroCleanup = nullptr;
+    llvm::BasicBlock *coroSuspend = nullptr;
+    FuncLiteral *literal = nullptr; // the fnc being generated, null for main
+};
+
+static thread_local std::vector<FunctionState> functionStates;
+
+// signatures of the top level fncs by name, what tail calls are checked against
+static thread_local std::map<std::string, const FuncLiteral *> topLevelFncs;
+
+// result types of the async fncs declared so far
+static thread_local std::map<const llvm::Function *, llvm::Type *> asyncResults;
+
+// cobalt param types of the externs declared so far
+static thread_local std::map<const llvm::Function *, std::vector<llvm::Type *>> externParams;
+
+void cblt::ast::collectAssigned(Node *node, std::set<std::string> &names) {
+    if (dynamic_cast<FuncLiteral *>(node)) {
+        return;
+    }
+    if (const auto *assign = dynamic_cast<AssignStmt *>(node)) {
+        if (const auto *ident = dynamic_cast<Identifier *>(assign->target.get())) {
+            names.insert(ident->value);
+        }
+    }
+    forEachChild(node, [&](Node *child) {
+        collectAssigned(child, names);
+    });
+}
+
+// assigned names live in an entry block alloca for mem2reg to promote, the
+// rest are bound straight to their ssa value
+static void bindName(const std::string &name, llvm::Value *value) {
+    const FunctionState &state = functionStates.back();
+    if (!state.mutables.count(name)) {
+        NamedValues[name] = value;
+        return;
+    }
+    llvm::BasicBlock &entry = state.fn->getEntryBlock();
+    llvm::IRBuilder<> b(&entry, entry.getFirstInsertionPt());
+    llvm::AllocaInst *slot = b.CreateAlloca(value->getType(), nullptr, name);
+    Builder->CreateStore(value, slot);
+    NamedValues[name] = slot;
+}
+
+// the current value of a bound name
+static llvm::Value *readName(llvm::Value *bound, const std::string &name) {
+    if (auto *slot = llvm::dyn_cast<llvm::AllocaInst>(bound)) {
+        return Builder->CreateLoad(slot->getAllocatedType(), slot, name);
+    }
+    return bound;
+}
+
+// escaping values go to the runtime heap, the rest to the current fnc's
+// region. an async fnc may finish on another thread, it has no region
+static llvm::Value *allocate(llvm::Value *size, const bool escapes) {
+    llvm::Type *i8Ptr = Builder->getInt8PtrTy();
+    if (escapes || functionStates.back().task) {
+        const llvm::FunctionCallee alloc = Module->getOrInsertFunction(
+            "__cblt_alloc", llvm::FunctionType::get(i8Ptr, {Builder->getInt64Ty()}, false));
+        return Builder->CreateCall(alloc, {size}, "mem");
+    }
+
+    FunctionState &state = functionStates.back();
+    state.regionAllocs++;
+    if (!state.regionMark) {
+        // entered once per invocation, releaseRegion adds the exits
+        llvm::BasicBlock &entry = state.fn->getEntryBlock();
+        llvm::IRBuilder<> b(&entry, entry.getFirstInsertionPt());
+        const llvm::FunctionCallee enter = Module->getOrInsertFunction(
+            "__cblt_region_enter", llvm::FunctionType::get(i8Ptr, false));
+        state.regionMark = b.CreateCall(enter, {}, "region");
+    }
+    const llvm::FunctionCallee alloc = Module->getOrInsertFunction(
+        "__cblt_region_alloc", llvm::FunctionType::get(i8Ptr, {Builder->getInt64Ty()}, false));
+    return Builder->CreateCall(alloc, {size}, "mem");
+}
+
+// exits the region before every ret, or before the tail call feeding it, and
+// on self tail calls that don't carry pointers into the next iteration
+static void releaseRegion(const FunctionState &state) {
+    if (!state.regionMark) {
+        return;
+    }
+    const llvm::FunctionCallee exitFn = Module->getOrInsertFunction(
+        "__cblt_region_exit", llvm::FunctionType::get(Builder->getVoidTy(), {Builder->getInt8PtrTy()}, false));
+    for (llvm::BasicBlock &bb: *state.fn) {
+        auto *ret = llvm::dyn_cast_or_null<llvm::ReturnInst>(bb.getTerminator());
+        if (!ret) {
+            continue;
+        }
+        llvm::Instruction *at = ret;
+        if (auto *call = llvm::dyn_cast_or_null<llvm::CallInst>(ret->getPrevNode()); call && call->isTailCall()) {
+            at = call;
+        }
+        llvm::CallInst::Create(exitFn, {state.regionMark}, "", at);
+    }
+    for (llvm::BranchInst *br: state.backEdges) {
+        llvm::CallInst::Create(exitFn, {state.regionMark}, "", br);
+    }
+}
+
+// out of range indexes abort in the runtime instead of reading past the data
+static void checkBounds(llvm::Value *index, llvm::Value *length) {
+    llvm::Function *fn = Builder->GetInsertBlock()->getParent();
+    llvm::BasicBlock *okBB = llvm::BasicBlock::Create(Context, "inbounds", fn);
+    llvm::BasicBlock *failBB = llvm::BasicBlock::Create(Context, "outofbounds", fn);
+
+    // unsigned compare catches negative indexes too
+    llvm::Value *inRange = Builder->CreateICmpULT(index, length, "inrange");
+    llvm::MDBuilder md(Context);
+    Builder->CreateCondBr(inRange, okBB, failBB, md.createBranchWeights(1 << 20, 1));
+
+    Builder->SetInsertPoint(failBB);
+    const llvm::FunctionCallee oob = Module->getOrInsertFunction(
+        "__cblt_index_oob",
+        llvm::FunctionType::get(Builder->getVoidTy(), {Builder->getInt64Ty(), Builder->getInt64Ty()}, false));
+    llvm::CallInst *call = Builder->CreateCall(oob, {index, length});
+    call->setDoesNotReturn();
+    Builder->CreateUnreachable();
+
+    Builder->SetInsertPoint(okBB);
+}
+
+static llvm::Value *makeSlice(llvm::StructType *type, llvm::Value *data, llvm::Value *length) {
+    llvm::Value *slice = llvm::UndefValue::get(type);
+    slice = Builder->CreateInsertValue(slice, data, 0);
+    return Builder->CreateInsertValue(slice, length, 1);
+}
+
+// closure values whose code is known here, calls through them are emitted direct
+static thread_local std::map<llvm::Value *, llvm::Function *> knownClosures;
+
+static llvm::Value *makeClosure(llvm::Function *code, llvm::Value *env) {
+    const llvm::FunctionType *codeType = code->getFunctionType();
+    llvm::StructType *type = closureType(
+        llvm::FunctionType::get(codeType->getReturnType(), codeType->params().drop_front(), false));
+    llvm::Value *closure = llvm::UndefValue::get(type);
+    closure = Builder->CreateInsertValue(closure, Builder->CreateBitCast(code, Builder->getInt8PtrTy()), 0);
+    closure = Builder->CreateInsertValue(closure, env, 1, "closure");
+    knownClosures[closure] = code;
+    return closure;
+}
+
+// top level fncs used as values get a wrapper that ignores the env
+static llvm::Function *closureThunk(llvm::Function *fn) {
+    const std::string name = fn->getName().str() + ".closure";
+    if (llvm::Function *thunk = Module->getFunction(name)) {
+        return thunk;
+    }
+
+    std::vector<llvm::Type *> params{Builder->getInt8PtrTy()};
+    for (const auto &arg: fn->args()) {
+        params.push_back(arg.getType());
+    }
+    llvm::Function *thunk = llvm::Function::Create(llvm::FunctionType::get(fn->getReturnType(), params, false),
+                                                   llvm::Function::InternalLinkage, name, Module.get());
+    llvm::IRBuilder<> b(llvm::BasicBlock::Create(Context, "entry", thunk));
+    std::vector<llvm::Value *> args;
+    for (auto arg = thunk->arg_begin() + 1; arg != thunk->arg_end(); ++arg) {
+        args.push_back(&*arg);
+    }
+    llvm::CallInst *call = b.CreateCall(fn, args);
+    call->setTailCallKind(llvm::CallInst::TCK_Tail);
+    b.CreateRet(call);
+    return thunk;
+}
+
 llvm::Value *NumLiteral::codegen() {
     return llvm::ConstantFP::get(Context, llvm::APFloat(value));
 }
 
 llvm::Value *Boolean::codegen() {
-    return nullptr;
+    return llvm::ConstantInt::getBool(Context, value);
+}
+
+llvm::Value *Identifier::codegen() {
+    const auto it = NamedValues.find(value);
+    if (it != NamedValues.end()) {
+        return readName(it->second, value);
+    }
+    if (llvm::Function *fn = Module->getFunction(value); fn && value != "main") {
+        if (fn->hasFnAttribute("cblt.async")) {
+            return logErrorV("async fnc " + value + " can only be awaited or spawned", token.line);
+        }
+        if (externParams.count(fn)) {
+            return logErrorV("extern fnc " + value + " can only be called", token.line);
+        }
+        return makeClosure(closureThunk(fn), llvm::ConstantPointerNull::get(Builder->getInt8PtrTy()));
+    }
+    return logErrorV("unknown identifier " + value, token.line);
+}
+
+// the async fnc a call names, unless a local name shadows it
+static llvm::Function *asyncCallee(Expr *expr) {
+    const auto *call = dynamic_cast<CallExpr *>(expr);
+    const auto *ident = call ? dynamic_cast<Identifier *>(call->function.get()) : nullptr;
+    if (!ident || NamedValues.count(ident->value)) {
+        return nullptr;
+    }
+    llvm::Function *fn = Module->getFunction(ident->value);
+    return fn && fn->hasFnAttribute("cblt.async") ? fn : nullptr;
+}
+
+// creates the coroutine for a call to an async fnc and returns its handle.
+// unless lazy it runs up to its first suspend point first
+static llvm::Value *startCoroutine(CallExpr &call, llvm::Function *callee, llvm::Value *task, llvm::Value *out,
+                                   const bool lazy) {
+    if (callee->arg_size() - 3 != call.args.size()) {
+        return logErrorV("fnc " + call.function->String() + " expects " + std::to_string(callee->arg_size() - 3) +
+                         " args, got=" + std::to_string(call.args.size()), call.token.line);
+    }
+    std::vector<llvm::Value *> argsV{task, out, Builder->getInt1(lazy)};
+    for (size_t i = 0; i < call.args.size(); i++) {
+        llvm::Value *v = call.args[i]->codegen();
+        if (!v) {
+            return nullptr;
+        }
+        v = convert(v, callee->getArg(i + 3)->getType());
+        if (!v) {
+            return logErrorV("argument " + std::to_string(i) + " to " + call.function->String() +
+                             " has the wrong type", call.token.line);
+        }
+        argsV.push_back(v);
+    }
+    return Builder->CreateCall(callee, argsV, "coro");
+}
+
+// suspends the current async fnc, code after runs once it's resumed
+static void suspend(const FunctionState &state) {
+    llvm::Value *s = Builder->CreateCall(llvm::Intrinsic::getDeclaration(Module.get(), llvm::Intrinsic::coro_suspend),
+                                         {llvm::ConstantTokenNone::get(Context), Builder->getFalse()}, "suspend");
+    llvm::BasicBlock *resumed = llvm::BasicBlock::Create(Context, "resumed", state.fn);
+    llvm::SwitchInst *sw = Builder->CreateSwitch(s, state.coroSuspend, 2);
+    sw->addCase(Builder->getInt8(0), resumed);
+    sw->addCase(Builder->getInt8(1), state.coroCleanup);
+    Builder->SetInsertPoint(resumed);
+}
+
+// await f(x) runs f as part of the awaiting task, resuming it until it's done.
+// the frame is freed right after, which lets coro-elide put it in ours.
+// await t takes the result of a spawned task once it's finished. outside an
+// async fnc both block the thread, which runs other tasks meanwhile
+static llvm::Value *awaitExpr(const PrefixExpr &expr) {
+    const FunctionState &state = functionStates.back();
+    llvm::Type *i8Ptr = Builder->getInt8PtrTy();
+    llvm::Function *fn = Builder->GetInsertBlock()->getParent();
+
+    if (llvm::Function *callee = asyncCallee(expr.right.get())) {
+        llvm::Type *resultType = asyncResults[callee];
+        llvm::BasicBlock &entry = fn->getEntryBlock();
+        llvm::IRBuilder<> b(&entry, entry.getFirstInsertionPt());
+        llvm::AllocaInst *slot = b.CreateAlloca(resultType, nullptr, "result");
+
+        llvm::Value *task = state.task;
+        if (!task) {
+            const llvm::FunctionCallee newTask = Module->getOrInsertFunction(
+                "__cblt_task_new", llvm::FunctionType::get(taskType(), false));
+            task = Builder->CreateCall(newTask, {}, "self");
+        }
+        llvm::Value *coro = startCoroutine(*static_cast<CallExpr *>(expr.right.get()), callee, task, slot, false);
+        if (!coro) {
+            return nullptr;
+        }
+
+        if (state.task) {
+            // f suspends when it awaits an unfinished task, which suspends us too
+            llvm::BasicBlock *poll = llvm::BasicBlock::Create(Context, "await.poll", fn);
+            llvm::BasicBlock *wait = llvm::BasicBlock::Create(Context, "await.wait", fn);
+            llvm::BasicBlock *done = llvm::BasicBlock::Create(Context, "await.done", fn);
+            Builder->CreateBr(poll);
+            Builder->SetInsertPoint(poll);
+            Builder->CreateCondBr(Builder->CreateCall(
+                                      llvm::Intrinsic::getDeclaration(Module.get(), llvm::Intrinsic::coro_done),
+                                      {coro}), done, wait);
+            Builder->SetInsertPoint(wait);
+            suspend(state);
+            Builder->CreateCall(llvm::Intrinsic::getDeclaration(Module.get(), llvm::Intrinsic::coro_resume), {coro});
+            Builder->CreateBr(poll);
+            Builder->SetInsertPoint(done);
+        } else {
+            const llvm::FunctionCallee drive = Module->getOrInsertFunction(
+                "__cblt_task_drive", llvm::FunctionType::get(Builder->getVoidTy(), {taskType(), i8Ptr}, false));
+            Builder->CreateCall(drive, {task, coro});
+        }
+        llvm::Value *result = Builder->CreateLoad(resultType, slot, "awaited");
+        Builder->CreateCall(llvm::Intrinsic::getDeclaration(Module.get(), llvm::Intrinsic::coro_destroy), {coro});
+        return result;
+    }
+
+    llvm::Value *task = expr.right->codegen();
+    if (!task) {
+        return nullptr;
+    }
+    if (task->getType() != taskType()) {
+        return logErrorV("await needs a task or a call to an async fnc", expr.token.line);
+    }
+    if (!state.task) {
+        const llvm::FunctionCallee wait = Module->getOrInsertFunction(
+            "__cblt_task_wait", llvm::FunctionType::get(Builder->getDoubleTy(), {taskType()}, false));
+        return Builder->CreateCall(wait, {task}, "awaited");
+    }
+
+    const llvm::FunctionCallee ready = Module->getOrInsertFunction(
+        "__cblt_task_await", llvm::FunctionType::get(Builder->getInt1Ty(), {taskType(), taskType()}, false));
+    llvm::BasicBlock *wait = llvm::BasicBlock::Create(Context, "await.wait", fn);
+    llvm::BasicBlock *done = llvm::BasicBlock::Create(Context, "await.done", fn);
+    Builder->CreateCondBr(Builder->CreateCall(ready, {state.task, task}, "ready"), done, wait);
+    // the runtime resumes us once the task is finished
+    Builder->SetInsertPoint(wait);
+    suspend(state);
+    Builder->CreateBr(done);
+    Builder->SetInsertPoint(done);
+    const llvm::FunctionCallee take = Module->getOrInsertFunction(
+        "__cblt_task_take", llvm::FunctionType::get(Builder->getDoubleTy(), {taskType()}, false));
+    return Builder->CreateCall(take, {task}, "awaited");
+}
+
+// spawn f(x) makes a task for f and schedules it, f returns into the task
+static llvm::Value *spawnExpr(const PrefixExpr &expr) {
+    llvm::Function *callee = asyncCallee(expr.right.get());
+    if (!callee) {
+        return logErrorV("spawn needs a call to an async fnc", expr.token.line);
+    }
+    if (!asyncResults[callee]->isDoubleTy()) {
+        return logErrorV("spawn needs an async fnc returning num", expr.token.line);
+    }
+
+    const llvm::FunctionCallee newTask = Module->getOrInsertFunction(
+        "__cblt_task_new", llvm::FunctionType::get(taskType(), false));
+    llvm::Value *task = Builder->CreateCall(newTask, {}, "task");
+    // a Task starts with its result
+    llvm::Value *out = Builder->CreateBitCast(task, Builder->getDoubleTy()->getPointerTo(), "out");
+    llvm::Value *coro = startCoroutine(*static_cast<CallExpr *>(expr.right.get()), callee, task, out, true);
+    if (!coro) {
+        return nullptr;
+    }
+    const llvm::FunctionCallee schedule = Module->getOrInsertFunction(
+        "__cblt_task_schedule",
+        llvm::FunctionType::get(Builder->getVoidTy(), {taskType(), Builder->getInt8PtrTy()}, false));
+    Builder->CreateCall(schedule, {task, coro});
+    return task;
+}
+
+llvm::Value *PrefixExpr::codegen() {
+    if (op == "await") {
+        return awaitExpr(*this);
+    }
+    if (op == "spawn") {
+        return spawnExpr(*this);
+    }
+    llvm::Value *operand = right->codegen();
+    if (!operand) {
+        return nullptr;
+    }
+
+    if (op == "-" && operand->getType()->isDoubleTy()) {
+        return Builder->CreateFNeg(operand, "negtmp");
+    }
+    if (op == "!") {
+        if (operand->getType()->isIntegerTy(1)) {
+            return Builder->CreateNot(operand, "nottmp");
+        }
+        return Builder->CreateFCmpOEQ(operand, llvm::ConstantFP::get(Context, llvm::APFloat(0.0)), "nottmp");
+    }
+    return logErrorV("invalid operand for prefix " + op, token.line);
+}
+
+// && and || only evaluate rhs when lhs doesn't already decide the result
+static llvm::Value *shortCircuit(const InfixExpr &expr) {
+    const bool isAnd = expr.op == "&&";
+    llvm::Value *l = expr.lhs->codegen();
+    if (!l) {
+        return nullptr;
+    }
+    l = convert(l, Builder->getInt1Ty());
+    if (!l) {
+        return logErrorV("operands of " + expr.op + " must be num or bool", expr.token.line);
+    }
+
+    llvm::Function *fn = Builder->GetInsertBlock()->getParent();
+    llvm::BasicBlock *lhsBB = Builder->GetInsertBlock();
+    llvm::BasicBlock *rhsBB = llvm::BasicBlock::Create(Context, isAnd ? "and.rhs" : "or.rhs", fn);
+    llvm::BasicBlock *mergeBB = llvm::BasicBlock::Create(Context, isAnd ? "and.end" : "or.end");
+
+    const std::string site = cblt::pgo::nextSite(isAnd ? "and" : "or");
+    cblt::pgo::counter(site);
+    llvm::BranchInst *br = Builder->CreateCondBr(isAnd ? l : Builder->CreateNot(l, "lhs.false"), rhsBB, mergeBB);
+    cblt::pgo::weighBranch(br, site + ".rhs", site);
+
+    Builder->SetInsertPoint(rhsBB);
+    cblt::pgo::counter(site + ".rhs");
+    llvm::Value *r = expr.rhs->codegen();
+    if (!r) {
+        return nullptr;
+    }
+    r = convert(r, Builder->getInt1Ty());
+    if (!r) {
+        return logErrorV("operands of " + expr.op + " must be num or bool", expr.token.line);
+    }
+    rhsBB = Builder->GetInsertBlock();
+    Builder->CreateBr(mergeBB);
+
+    fn->getBasicBlockList().push_back(mergeBB);
+    Builder->SetInsertPoint(mergeBB);
+    llvm::PHINode *phi = Builder->CreatePHI(Builder->getInt1Ty(), 2, isAnd ? "andtmp" : "ortmp");
+    phi->addIncoming(Builder->getInt1(!isAnd), lhsBB);
+    phi->addIncoming(r, rhsBB);
+    return phi;
+}
+
+llvm::Value *InfixExpr::codegen() {
+    if (op == "&&" || op == "||") {
+        return shortCircuit(*this);
+    }
+
+    llvm::Value *l = lhs->codegen();
+    llvm::Value *r = rhs->codegen();
+    if (!l || !r) {
+        return nullptr;
+    }
+
+    if (l->getType() != r->getType()) {
+        return logErrorV("mismatched operand types for " + op, token.line);
+    }
+
+    // + on strs copies both into a new str
+    if (l->getType() == strType()) {
+        if (op != "+") {
+            return logErrorV("invalid str operator " + op, token.line);
+        }
+        llvm::Value *lLen = Builder->CreateExtractValue(l, 1, "llen");
+        llvm::Value *rLen = Builder->CreateExtractValue(r, 1, "rlen");
+        llvm::Value *len = Builder->CreateAdd(lLen, rLen, "len");
+        llvm::Value *data = allocate(len, escapes);
+        Builder->CreateMemCpy(data, llvm::MaybeAlign(1), Builder->CreateExtractValue(l, 0), llvm::MaybeAlign(1),
+                              lLen);
+        Builder->CreateMemCpy(Builder->CreateInBoundsGEP(Builder->getInt8Ty(), data, lLen), llvm::MaybeAlign(1),
+                              Builder->CreateExtractValue(r, 0), llvm::MaybeAlign(1), rLen);
+        return makeSlice(strType(), data, len);
+    }
+    if (!l->getType()->isDoubleTy() && !l->getType()->isIntegerTy(1)) {
+        return logErrorV("invalid operands for " + op, token.line);
+    }
+
+    // bools only compare for equality
+    if (l->getType()->isIntegerTy(1)) {
+        if (op == "==") return Builder->CreateICmpEQ(l, r, "eqtmp");
+        if (op == "!=") return Builder->CreateICmpNE(l, r, "neqtmp");
+        return logErrorV("invalid bool operator " + op, token.line);
+    }
+
+    if (op == "+") return Builder->CreateFAdd(l, r, "addtmp");
+    if (op == "-") return Builder->CreateFSub(l, r, "subtmp");
+    if (op == "*") return Builder->CreateFMul(l, r, "multmp");
+    if (op == "/") return Builder->CreateFDiv(l, r, "divtmp");
+    if (op == "%") return Builder->CreateFRem(l, r, "remtmp");
+    if (op == "<") return Builder->CreateFCmpOLT(l, r, "lttmp");
+    if (op == ">") return Builder->CreateFCmpOGT(l, r, "gttmp");
+    if (op == "<=") return Builder->CreateFCmpOLE(l, r, "letmp");
+    if (op == ">=") return Builder->CreateFCmpOGE(l, r, "getmp");
+    if (op == "==") return Builder->CreateFCmpOEQ(l, r, "eqtmp");
+    if (op == "!=") return Builder->CreateFCmpONE(l, r, "neqtmp");
+    return logErrorV("invalid infix operator " + op, token.line);
 }
 
 llvm::Value *VarDeclStmt::codegen() {
-    return nullptr;
+    llvm::Value *init;
+    if (value) {
+        init = value->codegen();
+        if (!init) {
+            return nullptr;
+        }
+    } else {
+        llvm::Type *ty = typeFor(type);
+        if (!ty) {
+            return logErrorV("unsupported type " + type + " for " + name->value, token.line);
+        }
+        init = llvm::Constant::getNullValue(ty);
+    }
+
+    if (!type.empty()) {
+        llvm::Type *ty = typeFor(type);
+        if (!ty) {
+            return logErrorV("unsupported type " + type + " for " + name->value, token.line);
+        }
+        init = convert(init, ty);
+        if (!init) {
+            return logErrorV("value of " + name->value + " is not a " + (type == "fnc" ? "fnc(num) -> num" : type),
+                             token.line);
+        }
+    }
+
+    bindName(name->value, init);
+    return init;
+}
+
+llvm::Value *AssignStmt::codegen() {
+    llvm::Value *v = value->codegen();
+    if (!v) {
+        return nullptr;
+    }
+
+    if (const auto *ident = dynamic_cast<Identifier *>(target.get())) {
+        const auto it = NamedValues.find(ident->value);
+        if (it == NamedValues.end()) {
+            return logErrorV("assignment to undeclared " + ident->value, token.line);
+        }
+        auto *slot = llvm::dyn_cast<llvm::AllocaInst>(it->second);
+        if (!slot) {
+            return logErrorV(ident->value + " is not assignable here", token.line);
+        }
+        llvm::Value *stored = convert(v, slot->getAllocatedType());
+        if (!stored) {
+            return logErrorV("value assigned to " + ident->value + " has the wrong type", token.line);
+        }
+        Builder->CreateStore(stored, slot);
+        return stored;
+    }
+
+    if (const auto *index = dynamic_cast<IndexExpr *>(target.get())) {
+        llvm::Value *array = index->left->codegen();
+        llvm::Value *idx = index->index->codegen();
+        if (!array || !idx) {
+            return nullptr;
+        }
+        if (array->getType() != arrayType() || !idx->getType()->isDoubleTy()) {
+            return logErrorV("only []num elements can be assigned through an index", token.line);
+        }
+        llvm::Value *stored = convert(v, Builder->getDoubleTy());
+        if (!stored) {
+            return logErrorV("array elements must be num", token.line);
+        }
+        llvm::Value *i = Builder->CreateFPToSI(idx, Builder->getInt64Ty(), "idx");
+        checkBounds(i, Builder->CreateExtractValue(array, 1, "len"));
+        llvm::Value *data = Builder->CreateExtractValue(array, 0, "data");
+        Builder->CreateStore(stored, Builder->CreateInBoundsGEP(Builder->getDoubleTy(), data, i));
+        return stored;
+    }
+    return logErrorV("can only assign to a name or an index", token.line);
+}
+
+// rotated: the condition guards entry once, then is checked again at the
+// latch, and the guard reaches the body through a preheader. loop passes get
+// the canonical form without having to rotate it themselves
+llvm::Value *WhileStmt::codegen() {
+    const auto loopCondition = [this]() -> llvm::Value * {
+        llvm::Value *condV = condition->codegen();
+        if (!condV) {
+            return nullptr;
+        }
+        condV = convert(condV, Builder->getInt1Ty());
+        if (!condV) {
+            return logErrorV("while condition must be num or bool", token.line);
+        }
+        return condV;
+    };
+
+    const std::string site = cblt::pgo::nextSite("while");
+    cblt::pgo::counter(site);
+    llvm::Value *guardV = loopCondition();
+    if (!guardV) {
+        return nullptr;
+    }
+
+    llvm::Function *fn = Builder->GetInsertBlock()->getParent();
+    llvm::BasicBlock *preheaderBB = llvm::BasicBlock::Create(Context, "while.ph", fn);
+    llvm::BasicBlock *bodyBB = llvm::BasicBlock::Create(Context, "while.body", fn);
+    llvm::BasicBlock *exitBB = llvm::BasicBlock::Create(Context, "while.end");
+    llvm::BranchInst *guard = Builder->CreateCondBr(guardV, preheaderBB, exitBB);
+    cblt::pgo::weighBranch(guard, site + ".enter", site);
+
+    Builder->SetInsertPoint(preheaderBB);
+    cblt::pgo::counter(site + ".enter");
+    llvm::BranchInst *enterBody = Builder->CreateBr(bodyBB);
+
+    Builder->SetInsertPoint(bodyBB);
+    cblt::pgo::counter(site + ".body");
+    const unsigned allocsBefore = functionStates.back().regionAllocs;
+    if (!body->codegen()) {
+        return nullptr;
+    }
+
+    if (!blockTerminated()) {
+        // names declared in the body are gone by the latch and anything that
+        // outlives an iteration was heap allocated, so each iteration drops
+        // what it put in the region
+        if (functionStates.back().regionAllocs != allocsBefore) {
+            llvm::Type *i8Ptr = Builder->getInt8PtrTy();
+            const llvm::FunctionCallee enter = Module->getOrInsertFunction(
+                "__cblt_region_enter", llvm::FunctionType::get(i8Ptr, false));
+            const llvm::FunctionCallee exitFn = Module->getOrInsertFunction(
+                "__cblt_region_exit", llvm::FunctionType::get(Builder->getVoidTy(), {i8Ptr}, false));
+            llvm::Value *mark = llvm::CallInst::Create(enter, {}, "loop.region", enterBody);
+            Builder->CreateCall(exitFn, {mark});
+        }
+
+        cblt::debug::setLine(token.line);
+        llvm::Value *latchV = loopCondition();
+        if (!latchV) {
+            return nullptr;
+        }
+        llvm::BranchInst *latch = Builder->CreateCondBr(latchV, bodyBB, exitBB);
+        cblt::pgo::weighLoop(latch, site + ".body", site + ".enter");
+    }
+
+    fn->getBasicBlockList().push_back(exitBB);
+    Builder->SetInsertPoint(exitBB);
+    return noValue();
+}
+
+// a c function. str and []num params are passed as their data pointer and
+// length, bool as a zero extended byte the way c compilers pass _Bool
+llvm::Value *ExternStmt::codegen() {
+    if (functionStates.size() != 1) {
+        return logErrorV("extern fnc must be at program level", token.line);
+    }
+
+    std::vector<llvm::Type *> types;
+    std::vector<llvm::Type *> cParams;
+    bool pointers = false;
+    for (size_t i = 0; i < parameters.size(); i++) {
+        llvm::Type *ty = typeFor(paramTypes[i]);
+        if (ty && holdsPointer(ty) && !closureSignature(ty)) {
+            cParams.push_back(ty->getStructElementType(0));
+            cParams.push_back(Builder->getInt64Ty());
+            pointers = true;
+        } else if (ty && (ty->isDoubleTy() || ty->isIntegerTy(1))) {
+            cParams.push_back(ty);
+        } else {
+            return logErrorV("unsupported extern parameter type " + paramTypes[i], token.line);
+        }
+        types.push_back(ty);
+    }
+    llvm::Type *retType = returnType.empty() ? Builder->getVoidTy() : typeFor(returnType);
+    if (!retType || !(retType->isVoidTy() || retType->isDoubleTy() || retType->isIntegerTy(1))) {
+        return logErrorV("unsupported extern return type " + returnType, token.line);
+    }
+
+    llvm::FunctionType *fnType = llvm::FunctionType::get(retType, cParams, false);
+    if (llvm::Function *existing = Module->getFunction(name)) {
+        // declaring the same extern twice is harmless
+        if (externParams.count(existing) && existing->getFunctionType() == fnType) {
+            return noValue();
+        }
+        return logErrorV("redefinition of fnc " + name, token.line);
+    }
+    llvm::Function *fn = llvm::Function::Create(fnType, llvm::Function::ExternalLinkage, name, Module.get());
+    fn->setCallingConv(llvm::CallingConv::C);
+    for (llvm::Argument &arg: fn->args()) {
+        if (arg.getType()->isIntegerTy(1)) {
+            arg.addAttr(llvm::Attribute::ZExt);
+        }
+    }
+    if (retType->isIntegerTy(1)) {
+        fn->addRetAttr(llvm::Attribute::ZExt);
+    }
+
+    // a pure extern can be hoisted, merged or dropped like an fadd. one
+    // that takes data may still read it, but nothing else
+    if (pure) {
+        fn->addFnAttr(llvm::Attribute::NoUnwind);
+        fn->addFnAttr(llvm::Attribute::WillReturn);
+        fn->addFnAttr(pointers ? llvm::Attribute::ReadOnly : llvm::Attribute::ReadNone);
+        if (pointers) {
+            fn->addFnAttr(llvm::Attribute::ArgMemOnly);
+        }
+        for (llvm::Argument &arg: fn->args()) {
+            if (arg.getType()->isPointerTy()) {
+                arg.addAttr(llvm::Attribute::NoCapture);
+                arg.addAttr(llvm::Attribute::ReadOnly);
+            }
+        }
+    }
+    externParams[fn] = std::move(types);
+    return noValue();
 }
 
+// top level statements become the body of main
 llvm::Value *Program::codegen() {
-    return nullptr;
+    // declare every top level fnc first so calls may come before definitions
+    std::vector<FuncLiteral *> fncs;
+    std::set<std::string> assigned;
+    for (const auto &stmt: stmts) {
+        if (const auto *exprStmt = dynamic_cast<ExprStmt *>(stmt.get())) {
+            if (auto *func = dynamic_cast<FuncLiteral *>(exprStmt->expr.get()); func && !func->name.empty()) {
+                fncs.push_back(func);
+            }
+        }
+        collectAssigned(stmt.get(), assigned);
+    }
+
+    llvm::TimeTraceScope scope("codegen", "main");
+    beginMain(fncs, std::move(assigned), stmts.empty() ? 1 : stmts.front()->TokenLine());
+    for (const auto &stmt: stmts) {
+        lowerTopLevel(*stmt);
+    }
+    return finishMain();
+}
+
+void cblt::ast::beginMain(const std::vector<FuncLiteral *> &fncs, std::set<std::string> assigned, const int firstLine) {
+    knownClosures.clear();
+    asyncResults.clear();
+    externParams.clear();
+    topLevelFncs.clear();
+    for (FuncLiteral *func: fncs) {
+        func->topLevel = true;
+        func->declare();
+        topLevelFncs[func->name] = func;
+    }
+
+    llvm::FunctionType *mainType = llvm::FunctionType::get(Builder->getInt32Ty(), false);
+    llvm::Function *mainFn = llvm::Function::Create(mainType, llvm::Function::ExternalLinkage, "main", Module.get());
+    Builder->SetInsertPoint(llvm::BasicBlock::Create(Context, "entry", mainFn));
+
+    cblt::debug::enterFunction(mainFn, firstLine);
+    cblt::pgo::enterFunction(mainFn);
+    functionStates.push_back({mainFn, nullptr, {}, nullptr, 0, {}, std::move(assigned)});
+}
+
+// code after a program level return is dropped
+void cblt::ast::lowerTopLevel(Stmt &stmt) {
+    if (blockTerminated()) {
+        return;
+    }
+    if (const auto *exprStmt = dynamic_cast<ExprStmt *>(&stmt)) {
+        if (auto *func = dynamic_cast<FuncLiteral *>(exprStmt->expr.get()); func && !func->name.empty()) {
+            func->topLevel = true;
+        }
+    }
+    cblt::debug::setLine(stmt.TokenLine());
+    stmt.codegen();
+}
+
+llvm::Function *cblt::ast::finishMain() {
+    llvm::Function *mainFn = functionStates.back().fn;
+    if (!blockTerminated()) {
+        Builder->CreateRet(Builder->getInt32(0));
+    }
+    releaseRegion(functionStates.back());
+    functionStates.pop_back();
+    cblt::pgo::leaveFunction();
+    cblt::debug::leaveFunction();
+    return mainFn;
 }
 
 llvm::Value *ExprStmt::codegen() {
-    return nullptr;
+    return expr->codegen();
 }
 
+// evaluates to its last statement, code after a return is dropped. names
+// declared inside go out of scope at the closing brace
 llvm::Value *BlockStmt::codegen() {
-    return nullptr;
+    const std::map<std::string, llvm::Value *> outer = NamedValues;
+    llvm::Value *last = noValue();
+    for (const auto &stmt: stmts) {
+        if (blockTerminated()) {
+            break;
+        }
+        cblt::debug::setLine(stmt->TokenLine());
+        last = stmt->codegen();
+        if (!last) {
+            break;
+        }
+    }
+    NamedValues = outer;
+    return last;
 }
 
 llvm::Value *ReturnStmt::codegen() {
-    return nullptr;
+    const FunctionState &state = functionStates.back();
+    // an async fnc stores its result and then still has to reach its final suspend
+    if (auto *call = dynamic_cast<CallExpr *>(returnValue.get()); call && !state.task) {
+        call->tail = true;
+    }
+
+    llvm::Type *retType = state.task ? state.resultType : state.fn->getReturnType();
+    llvm::Value *v = returnValue ? returnValue->codegen() : llvm::Constant::getNullValue(retType);
+    if (!v) {
+        return nullptr;
+    }
+    if (blockTerminated()) {
+        // self tail call, already branched back to the top of the fnc
+        return v;
+    }
+
+    llvm::Value *ret = convert(v, retType);
+    if (!ret) {
+        return logErrorV("return value does not match the fnc return type", token.line);
+    }
+    if (state.task) {
+        Builder->CreateStore(ret, state.out);
+        Builder->CreateBr(state.coroFinal);
+        return ret;
+    }
+    Builder->CreateRet(ret);
+    return ret;
+}
+
+// value producing, both arms merge through a phi when they agree on a type
+llvm::Value *IfExpr::codegen() {
+    llvm::Value *condV = condition->codegen();
+    if (!condV) {
+        return nullptr;
+    }
+    condV = convert(condV, Builder->getInt1Ty());
+    if (!condV) {
+        return logErrorV("if condition must be num or bool", token.line);
+    }
+
+    llvm::Function *fn = Builder->GetInsertBlock()->getParent();
+    llvm::BasicBlock *thenBB = llvm::BasicBlock::Create(Context, "then", fn);
+    llvm::BasicBlock *elseBB = llvm::BasicBlock::Create(Context, "else");
+    llvm::BasicBlock *mergeBB = llvm::BasicBlock::Create(Context, "ifcont");
+
+    const std::string site = cblt::pgo::nextSite("if");
+    cblt::pgo::counter(site);
+    llvm::BranchInst *br = Builder->CreateCondBr(condV, thenBB, elseBB);
+    cblt::pgo::weighBranch(br, site + ".then", site);
+
+    Builder->SetInsertPoint(thenBB);
+    cblt::pgo::counter(site + ".then");
+    llvm::Value *thenV = consequence->codegen();
+    if (!thenV) {
+        return nullptr;
+    }
+    llvm::BasicBlock *thenEnd = blockTerminated() ? nullptr : Builder->GetInsertBlock();
+    if (thenEnd) {
+        Builder->CreateBr(mergeBB);
+    }
+
+    fn->getBasicBlockList().push_back(elseBB);
+    Builder->SetInsertPoint(elseBB);
+    llvm::Value *elseV = alternative ? alternative->codegen() : nullptr;
+    if (alternative && !elseV) {
+        return nullptr;
+    }
+    llvm::BasicBlock *elseEnd = blockTerminated() ? nullptr : Builder->GetInsertBlock();
+    if (elseEnd) {
+        Builder->CreateBr(mergeBB);
+    }
+
+    fn->getBasicBlockList().push_back(mergeBB);
+    Builder->SetInsertPoint(mergeBB);
+
+    // an arm that returned contributes nothing to the merge
+    if (!thenEnd && !elseEnd) {
+        Builder->CreateUnreachable();
+        return noValue();
+    }
+    if (!elseV) {
+        return noValue();
+    }
+    if (thenEnd && elseEnd && thenV->getType() != elseV->getType()) {
+        return noValue();
+    }
+
+    llvm::Type *type = thenEnd ? thenV->getType() : elseV->getType();
+    llvm::PHINode *phi = Builder->CreatePHI(type, 2, "iftmp");
+    if (thenEnd) {
+        phi->addIncoming(thenV, thenEnd);
+    }
+    if (elseEnd) {
+        phi->addIncoming(elseV, elseEnd);
+    }
+    return phi;
+}
+
+llvm::Function *FuncLiteral::declare() {
+    if (topLevel) {
+        if (llvm::Function *existing = Module->getFunction(name)) {
+            return existing;
+        }
+    }
+
+    // closure code takes its environment first. an async fnc takes the Task it
+    // runs as, where to put its result and whether to suspend before starting,
+    // and returns its coroutine handle
+    if (async && !topLevel) {
+        logErrorV("async fnc must be a program level fnc", token.line);
+        return nullptr;
+    }
+    std::vector<llvm::Type *> params;
+    if (!topLevel) {
+        params.push_back(Builder->getInt8PtrTy());
+    }
+    for (size_t i = 0; i < parameters.size(); i++) {
+        llvm::Type *ty = typeFor(i < paramTypes.size() ? paramTypes[i] : "");
+        if (!ty) {
+            logErrorV("unsupported parameter type " + paramTypes[i], token.line);
+            return nullptr;
+        }
+        params.push_back(ty);
+    }
+    llvm::Type *retType = typeFor(returnType);
+    if (!retType) {
+        logErrorV("unsupported return type " + returnType, token.line);
+        return nullptr;
+    }
+
+    if (async) {
+        params.insert(params.begin(), {taskType(), retType->getPointerTo(), Builder->getInt1Ty()});
+    }
+
+    // only top level fncs are visible outside the module, llvm uniques the other names
+    llvm::FunctionType *fnType = llvm::FunctionType::get(async ? Builder->getInt8PtrTy() : retType, params, false);
+    llvm::Function *fn = llvm::Function::Create(
+        fnType, topLevel ? llvm::Function::ExternalLinkage : llvm::Function::InternalLinkage,
+        name.empty() ? "fnc" : name, Module.get());
+
+    auto arg = fn->arg_begin();
+    if (!topLevel) {
+        (arg++)->setName("env");
+    }
+    if (async) {
+        // coro-early insists on the presplit marker from the frontend
+        fn->addFnAttr("cblt.async");
+        fn->addFnAttr("coroutine.presplit", "0");
+        asyncResults[fn] = retType;
+        (arg++)->setName("task");
+        (arg++)->setName("out");
+        (arg++)->setName("lazy");
+    }
+    for (const auto &param: parameters) {
+        (arg++)->setName(param->value);
+    }
+    return fn;
 }
 
+// an async fnc is a switched-resume coroutine. its frame comes from the
+// runtime unless coro-elide can put it in its caller's, the lazy param has it
+// suspend before its first statement. every return stores the result and
+// branches to the final suspend, the coroutine is done from there on
+static void beginCoroutine(FunctionState &state) {
+    llvm::Function *fn = state.fn;
+    llvm::PointerType *i8Ptr = Builder->getInt8PtrTy();
+    llvm::Value *null = llvm::ConstantPointerNull::get(i8Ptr);
+    const auto intrinsic = [](const llvm::Intrinsic::ID id, const std::vector<llvm::Type *> &types = {}) {
+        return llvm::Intrinsic::getDeclaration(Module.get(), id, types);
+    };
+
+    llvm::Value *id = Builder->CreateCall(intrinsic(llvm::Intrinsic::coro_id),
+                                          {Builder->getInt32(0), null, null, null}, "id");
+    llvm::BasicBlock *from = Builder->GetInsertBlock();
+    llvm::BasicBlock *allocBB = llvm::BasicBlock::Create(Context, "coro.alloc", fn);
+    llvm::BasicBlock *beginBB = llvm::BasicBlock::Create(Context, "coro.begin", fn);
+    Builder->CreateCondBr(Builder->CreateCall(intrinsic(llvm::Intrinsic::coro_alloc), {id}, "needframe"),
+                          allocBB, beginBB);
+    Builder->SetInsertPoint(allocBB);
+    const llvm::FunctionCallee frameAlloc = Module->getOrInsertFunction(
+        "__cblt_frame_alloc", llvm::FunctionType::get(i8Ptr, {Builder->getInt64Ty()}, false));
+    llvm::Value *mem = Builder->CreateCall(
+        frameAlloc, {Builder->CreateCall(intrinsic(llvm::Intrinsic::coro_size, {Builder->getInt64Ty()}), {}, "size")},
+        "frame");
+    Builder->CreateBr(beginBB);
+    Builder->SetInsertPoint(beginBB);
+    llvm::PHINode *frame = Builder->CreatePHI(i8Ptr, 2, "frame");
+    frame->addIncoming(null, from);
+    frame->addIncoming(mem, allocBB);
+    llvm::Value *handle = Builder->CreateCall(intrinsic(llvm::Intrinsic::coro_begin), {id, frame}, "handle");
+
+    state.task = fn->getArg(0);
+    state.out = fn->getArg(1);
+    state.resultType = asyncResults[fn];
+    // appended once the body is generated
+    state.coroFinal = llvm::BasicBlock::Create(Context, "coro.final");
+    state.coroCleanup = llvm::BasicBlock::Create(Context, "coro.cleanup");
+    state.coroSuspend = llvm::BasicBlock::Create(Context, "coro.suspend");
+    const llvm::IRBuilderBase::InsertPoint ip = Builder->saveIP();
+
+    Builder->SetInsertPoint(state.coroFinal);
+    llvm::Value *s = Builder->CreateCall(intrinsic(llvm::Intrinsic::coro_suspend),
+                                         {llvm::ConstantTokenNone::get(Context), Builder->getTrue()}, "final");
+    llvm::BasicBlock *resumedDone = llvm::BasicBlock::Create(Context, "coro.done", fn);
+    llvm::SwitchInst *sw = Builder->CreateSwitch(s, state.coroSuspend, 2);
+    sw->addCase(Builder->getInt8(0), resumedDone);
+    sw->addCase(Builder->getInt8(1), state.coroCleanup);
+    Builder->SetInsertPoint(resumedDone);
+    Builder->CreateUnreachable();
+
+    Builder->SetInsertPoint(state.coroCleanup);
+    const llvm::FunctionCallee frameFree = Module->getOrInsertFunction(
+        "__cblt_frame_free", llvm::FunctionType::get(Builder->getVoidTy(), {i8Ptr, Builder->getInt64Ty()}, false));
+    Builder->CreateCall(frameFree, {
+                            Builder->CreateCall(intrinsic(llvm::Intrinsic::coro_free), {id, handle}, "mem"),
+                            Builder->CreateCall(intrinsic(llvm::Intrinsic::coro_size, {Builder->getInt64Ty()}), {},
+                                                "size")
+                        });
+    Builder->CreateBr(state.coroSuspend);
+
+    Builder->SetInsertPoint(state.coroSuspend);
+    Builder->CreateCall(intrinsic(llvm::Intrinsic::coro_end), {handle, Builder->getFalse()});
+    Builder->CreateRet(handle);
+    Builder->restoreIP(ip);
+
+    llvm::BasicBlock *lazyBB = llvm::BasicBlock::Create(Context, "coro.lazy", fn);
+    llvm::BasicBlock *startBB = llvm::BasicBlock::Create(Context, "coro.start", fn);
+    Builder->CreateCondBr(fn->getArg(2), lazyBB, startBB);
+    Builder->SetInsertPoint(lazyBB);
+    suspend(state);
+    Builder->CreateBr(startBB);
+    Builder->SetInsertPoint(startBB);
+}
+
+// enclosing values the body mentions, nested literals capture through us
+static void collectCaptures(Node *node, const FuncLiteral &func,
+                            std::vector<std::pair<std::string, llvm::Value *>> &captures) {
+    if (const auto *ident = dynamic_cast<Identifier *>(node)) {
+        const auto it = NamedValues.find(ident->value);
+        if (it == NamedValues.end()) {
+            return;
+        }
+        for (const auto &param: func.parameters) {
+            if (param->value == ident->value) {
+                return;
+            }
+        }
+        for (const auto &[name, value]: captures) {
+            if (name == ident->value) {
+                return;
+            }
+        }
+        captures.emplace_back(ident->value, readName(it->second, ident->value));
+        return;
+    }
+    forEachChild(node, [&](Node *child) {
+        collectCaptures(child, func, captures);
+    });
+}
+
+llvm::Value *FuncLiteral::codegen() {
+    llvm::Function *fn = declare();
+    if (!fn) {
+        return nullptr;
+    }
+    if (!fn->empty()) {
+        return logErrorV("redefinition of fnc " + name, token.line);
+    }
+
+    // captures are copied into the environment when the closure is made
+    std::vector<std::pair<std::string, llvm::Value *>> captures;
+    llvm::StructType *envType = nullptr;
+    if (!topLevel) {
+        collectCaptures(body.get(), *this, captures);
+    }
+    if (!captures.empty()) {
+        std::vector<llvm::Type *> fields;
+        for (const auto &[captured, value]: captures) {
+            fields.push_back(value->getType());
+        }
+        envType = llvm::StructType::get(Context, fields);
+    }
+
+    llvm::TimeTraceScope scope("codegen", fn->getName());
+    const llvm::IRBuilderBase::InsertPoint savedIP = Builder->saveIP();
+    std::map<std::string, llvm::Value *> savedNames = std::move(NamedValues);
+    NamedValues.clear();
+
+    llvm::BasicBlock *entry = llvm::BasicBlock::Create(Context, "entry", fn);
+    llvm::BasicBlock *header = llvm::BasicBlock::Create(Context, "tailrecurse", fn);
+    functionStates.push_back({fn, header, {}, nullptr, 0, {}, {}});
+    functionStates.back().literal = this;
+    collectAssigned(body.get(), functionStates.back().mutables);
+
+    Builder->SetInsertPoint(entry);
+    cblt::debug::enterFunction(fn, token.line);
+    cblt::pgo::enterFunction(fn);
+    if (envType) {
+        llvm::Value *env = Builder->CreateBitCast(fn->getArg(0), envType->getPointerTo(), "envp");
+        for (unsigned i = 0; i < captures.size(); i++) {
+            bindName(captures[i].first, Builder->CreateLoad(
+                         envType->getElementType(i), Builder->CreateStructGEP(envType, env, i), captures[i].first));
+        }
+    }
+    if (async) {
+        beginCoroutine(functionStates.back());
+    }
+    llvm::BasicBlock *preheader = Builder->GetInsertBlock();
+    Builder->CreateBr(header);
+
+    // params are phis so self recursion in tail position becomes a loop,
+    // simplifycfg folds them away again when nothing branches back
+    Builder->SetInsertPoint(header);
+    std::vector<llvm::PHINode *> phis;
+    const unsigned firstParam = fn->arg_size() - parameters.size();
+    for (auto &arg: fn->args()) {
+        if (arg.getArgNo() < firstParam) {
+            continue;
+        }
+        llvm::PHINode *phi = Builder->CreatePHI(arg.getType(), 2, arg.getName());
+        phi->addIncoming(&arg, preheader);
+        phis.push_back(phi);
+    }
+    // slots for assigned params are stored after the last phi
+    for (llvm::PHINode *phi: phis) {
+        bindName(std::string(phi->getIncomingValue(0)->getName()), phi);
+    }
+    functionStates.back().params = std::move(phis);
+
+    FunctionState &state = functionStates.back();
+    llvm::Value *last = body->codegen();
+    if (last && !blockTerminated()) {
+        // falling off the end returns the last expression
+        llvm::Type *retType = async ? state.resultType : fn->getReturnType();
+        llvm::Value *ret = convert(last, retType);
+        ret = ret ? ret : llvm::Constant::getNullValue(retType);
+        if (async) {
+            Builder->CreateStore(ret, state.out);
+            Builder->CreateBr(state.coroFinal);
+        } else {
+            Builder->CreateRet(ret);
+        }
+    }
+    if (async) {
+        fn->getBasicBlockList().push_back(state.coroFinal);
+        fn->getBasicBlockList().push_back(state.coroCleanup);
+        fn->getBasicBlockList().push_back(state.coroSuspend);
+    }
+    cblt::pgo::leaveFunction();
+    cblt::debug::leaveFunction();
+    releaseRegion(state);
+    functionStates.pop_back();
+
+    NamedValues = std::move(savedNames);
+    Builder->restoreIP(savedIP);
+
+    if (!last) {
+        return nullptr;
+    }
+    // what the verifier found goes with the other errors, not to the process's stderr
+    std::string problems;
+    llvm::raw_string_ostream verifyOut(problems);
+    if (llvm::verifyFunction(*fn, &verifyOut)) {
+        verifyOut.flush();
+        while (!problems.empty() && problems.back() == '\n') {
+            problems.pop_back();
+        }
+        return logErrorV("generated invalid code for fnc " + std::string(fn->getName()) + ": " + problems,
+                         token.line);
+    }
+    if (topLevel) {
+        return fn;
+    }
+
+    // only closures that may outlive their creator pay for a heap environment
+    llvm::Value *env = llvm::ConstantPointerNull::get(Builder->getInt8PtrTy());
+    if (envType) {
+        llvm::Value *envPtr;
+        if (escapes) {
+            const uint64_t size = Module->getDataLayout().getTypeAllocSize(envType);
+            envPtr = Builder->CreateBitCast(allocate(Builder->getInt64(size), true), envType->getPointerTo(), "env");
+        } else {
+            // entry block allocas are what sroa and mem2reg look at
+            llvm::BasicBlock &creatorEntry = Builder->GetInsertBlock()->getParent()->getEntryBlock();
+            llvm::IRBuilder<> entryBuilder(&creatorEntry, creatorEntry.begin());
+            envPtr = entryBuilder.CreateAlloca(envType, nullptr, "env");
+        }
+        for (unsigned i = 0; i < captures.size(); i++) {
+            Builder->CreateStore(captures[i].second, Builder->CreateStructGEP(envType, envPtr, i));
+        }
+        env = Builder->CreateBitCast(envPtr, Builder->getInt8PtrTy());
+    }
+
+    llvm::Value *closure = makeClosure(fn, env);
+    if (!name.empty()) {
+        NamedValues[name] = closure;
+    }
+    return closure;
+}
+
+// str and []num args are split into their data pointer and length, nothing
+// is copied
+static llvm::Value *callExtern(const CallExpr &call, llvm::Function *callee,
+                               const std::vector<llvm::Type *> &params) {
+    if (params.size() != call.args.size()) {
+        return logErrorV("fnc " + call.function->String() + " expects " + std::to_string(params.size()) +
+                         " args, got=" + std::to_string(call.args.size()), call.token.line);
+    }
+    std::vector<llvm::Value *> argsV;
+    for (size_t i = 0; i < call.args.size(); i++) {
+        llvm::Value *v = call.args[i]->codegen();
+        if (!v) {
+            return nullptr;
+        }
+        v = convert(v, params[i]);
+        if (!v) {
+            return logErrorV("argument " + std::to_string(i) + " to " + call.function->String() +
+                             " has the wrong type", call.token.line);
+        }
+        if (holdsPointer(params[i])) {
+            argsV.push_back(Builder->CreateExtractValue(v, 0, "data"));
+            argsV.push_back(Builder->CreateExtractValue(v, 1, "len"));
+        } else {
+            argsV.push_back(v);
+        }
+    }
+    llvm::CallInst *result = Builder->CreateCall(callee, argsV, callee->getReturnType()->isVoidTy() ? "" : "calltmp");
+    result->setCallingConv(callee->getCallingConv());
+    return result->getType()->isVoidTy() ? noValue() : result;
+}
+
+// builtins are called by name when no fnc, extern or local of that name is
+// in scope, their param types are as for typeFor, empty taking str or []num.
+// readFile gives a view of a mapped file and slice a view into a str, so
+// neither copies. the file ones are in runtime/io.cpp
+static const std::map<std::string, std::vector<std::string>> builtins = {
+    {"len", {""}},
+    {"slice", {"str", "num", "num"}},
+    {"readFile", {"str"}},
+    {"lineEnd", {"str", "num"}},
+    {"parseColumn", {"str", "num", "str"}},
+    {"openWriter", {"str"}},
+    {"write", {"num", "str"}},
+    {"writeLine", {"num", "str"}},
+    {"writeNum", {"num", "num"}},
+    {"closeWriter", {"num"}},
+};
+
+static llvm::Value *callBuiltin(const CallExpr &call, const std::string &name) {
+    const std::vector<std::string> &types = builtins.at(name);
+    if (types.size() != call.args.size()) {
+        return logErrorV("fnc " + name + " expects " + std::to_string(types.size()) + " args, got=" +
+                         std::to_string(call.args.size()), call.token.line);
+    }
+    std::vector<llvm::Value *> args;
+    for (size_t i = 0; i < call.args.size(); i++) {
+        llvm::Value *v = call.args[i]->codegen();
+        if (!v) {
+            return nullptr;
+        }
+        if (types[i].empty()) {
+            v = v->getType() == strType() || v->getType() == arrayType() ? v : nullptr;
+        } else {
+            v = convert(v, typeFor(types[i]));
+        }
+        if (!v) {
+            return logErrorV("argument " + std::to_string(i) + " to " + name + " has the wrong type",
+                             call.token.line);
+        }
+        args.push_back(v);
+    }
+
+    llvm::Type *i8Ptr = Builder->getInt8PtrTy();
+    llvm::Type *i64 = Builder->getInt64Ty();
+    const auto toInt = [](llvm::Value *num) {
+        return Builder->CreateFPToSI(num, Builder->getInt64Ty(), "int");
+    };
+    const auto toNum = [](llvm::Value *i) {
+        return Builder->CreateSIToFP(i, Builder->getDoubleTy(), "num");
+    };
+    const auto runtime = [](const char *fn, llvm::Type *ret, const std::vector<llvm::Type *> &params) {
+        return Module->getOrInsertFunction(fn, llvm::FunctionType::get(ret, params, false));
+    };
+    // results too big for registers come back through a slot
+    const auto slot = [](llvm::Type *type) {
+        llvm::BasicBlock &entry = Builder->GetInsertBlock()->getParent()->getEntryBlock();
+        llvm::IRBuilder<> b(&entry, entry.getFirstInsertionPt());
+        return b.CreateAlloca(type, nullptr, "slot");
+    };
+    const auto data = [](llvm::Value *slice) { return Builder->CreateExtractValue(slice, 0, "data"); };
+    const auto length = [](llvm::Value *slice) { return Builder->CreateExtractValue(slice, 1, "len"); };
+
+    if (name == "len") {
+        return toNum(length(args[0]));
+    }
+    if (name == "slice") {
+        llvm::Value *from = toInt(args[1]);
+        llvm::Value *to = toInt(args[2]);
+        checkBounds(to, Builder->CreateAdd(length(args[0]), Builder->getInt64(1)));
+        checkBounds(from, Builder->CreateAdd(to, Builder->getInt64(1)));
+        return makeSlice(strType(), Builder->CreateInBoundsGEP(Builder->getInt8Ty(), data(args[0]), from),
+                         Builder->CreateSub(to, from, "len"));
+    }
+    if (name == "readFile") {
+        llvm::AllocaInst *out = slot(strType());
+        Builder->CreateCall(runtime("__cblt_read_file", Builder->getVoidTy(), {i8Ptr, i64, out->getType()}),
+                            {data(args[0]), length(args[0]), out});
+        return Builder->CreateLoad(strType(), out, "file");
+    }
+    if (name == "lineEnd") {
+        llvm::FunctionCallee lineEnd = runtime("__cblt_line_end", i64, {i8Ptr, i64, i64});
+        auto *fn = llvm::cast<llvm::Function>(lineEnd.getCallee());
+        fn->addFnAttr(llvm::Attribute::NoUnwind);
+        fn->addFnAttr(llvm::Attribute::ReadOnly);
+        fn->addFnAttr(llvm::Attribute::ArgMemOnly);
+        return toNum(Builder->CreateCall(lineEnd, {data(args[0]), length(args[0]), toInt(args[1])}, "end"));
+    }
+    if (name == "parseColumn") {
+        llvm::AllocaInst *out = slot(arrayType());
+        Builder->CreateCall(runtime("__cblt_parse_column", Builder->getVoidTy(),
+                                    {i8Ptr, i64, i64, i8Ptr, i64, out->getType()}),
+                            {data(args[0]), length(args[0]), toInt(args[1]), data(args[2]), length(args[2]), out});
+        return Builder->CreateLoad(arrayType(), out, "column");
+    }
+    if (name == "openWriter") {
+        return toNum(Builder->CreateCall(runtime("__cblt_writer_open", i64, {i8Ptr, i64}),
+                                         {data(args[0]), length(args[0])}, "writer"));
+    }
+    if (name == "write" || name == "writeLine") {
+        Builder->CreateCall(runtime(name == "write" ? "__cblt_write" : "__cblt_write_line", Builder->getVoidTy(),
+                                    {i64, i8Ptr, i64}),
+                            {toInt(args[0]), data(args[1]), length(args[1])});
+        return noValue();
+    }
+    if (name == "writeNum") {
+        Builder->CreateCall(runtime("__cblt_write_num", Builder->getVoidTy(), {i64, Builder->getDoubleTy()}),
+                            {toInt(args[0]), args[1]});
+        return noValue();
+    }
+    Builder->CreateCall(runtime("__cblt_writer_close", Builder->getVoidTy(), {i64}), {toInt(args[0])});
+    return noValue();
+}
+
+llvm::Value *CallExpr::codegen() {
+    // either a top level fnc by name, or a closure value whose code may be known
+    llvm::Function *callee = nullptr;
+    llvm::Value *closure = nullptr;
+    const auto *ident = dynamic_cast<Identifier *>(function.get());
+    if (ident && NamedValues.find(ident->value) == NamedValues.end()) {
+        // main is the program itself, not a fnc it can call
+        callee = ident->value != "main" ? Module->getFunction(ident->value) : nullptr;
+        if (!callee && builtins.count(ident->value)) {
+            return callBuiltin(*this, ident->value);
+        }
+        if (!callee) {
+            return logErrorV("call to unknown fnc " + ident->value, token.line);
+        }
+        if (callee->hasFnAttribute("cblt.async")) {
+            return logErrorV("call to async fnc " + ident->value + " needs await or spawn", token.line);
+        }
+        if (const auto it = externParams.find(callee); it != externParams.end()) {
+            return callExtern(*this, callee, it->second);
+        }
+    } else {
+        closure = function->codegen();
+        if (!closure) {
+            return nullptr;
+        }
+        if (!closureSignature(closure->getType())) {
+            return logErrorV(function->String() + " is not a fnc", token.line);
+        }
+        if (const auto it = knownClosures.find(closure); it != knownClosures.end()) {
+            callee = it->second;
+        }
+    }
+
+    // the fnc value's type is its signature, whether or not its code is known
+    llvm::FunctionType *sig = closure ? closureSignature(closure->getType()) : callee->getFunctionType();
+    if (sig->getNumParams() != args.size()) {
+        return logErrorV("fnc " + function->String() + " expects " + std::to_string(sig->getNumParams()) +
+                         " args, got=" + std::to_string(args.size()), token.line);
+    }
+
+    std::vector<llvm::Value *> argsV;
+    if (closure) {
+        argsV.push_back(Builder->CreateExtractValue(closure, 1, "env"));
+    }
+    for (size_t i = 0; i < args.size(); i++) {
+        llvm::Value *v = args[i]->codegen();
+        if (!v) {
+            return nullptr;
+        }
+        v = convert(v, sig->getParamType(i));
+        if (!v) {
+            return logErrorV("argument " + std::to_string(i) + " to " + function->String() + " has the wrong type",
+                             token.line);
+        }
+        argsV.push_back(v);
+    }
+
+    const std::string site = cblt::pgo::nextSite("call");
+    cblt::pgo::counter(site);
+
+    // sema::tailCallKind decides, -Wnon-tail-recursion warns by the same rule
+    sema::TailCall kind = sema::TailCall::NONE;
+    if (tail && !closure && !functionStates.empty() && functionStates.back().literal) {
+        FunctionState &state = functionStates.back();
+        const FuncLiteral *target = nullptr;
+        if (state.fn == callee) {
+            target = state.literal;
+        } else if (const auto it = topLevelFncs.find(ident->value); it != topLevelFncs.end()) {
+            target = it->second;
+        }
+        kind = sema::tailCallKind(*state.literal, *this, target);
+    }
+
+    if (kind == sema::TailCall::LOOP) {
+        FunctionState &state = functionStates.back();
+        bool carriesPointer = false;
+        for (size_t i = 0; i < argsV.size(); i++) {
+            state.params[i]->addIncoming(argsV[i], Builder->GetInsertBlock());
+            carriesPointer = carriesPointer || holdsPointer(argsV[i]->getType());
+        }
+        llvm::BranchInst *br = Builder->CreateBr(state.header);
+        if (!carriesPointer) {
+            state.backEdges.push_back(br);
+        }
+        return noValue();
+    }
+
+    llvm::CallInst *call;
+    if (callee) {
+        call = Builder->CreateCall(callee, argsV, "calltmp");
+    } else {
+        std::vector<llvm::Type *> types{Builder->getInt8PtrTy()};
+        types.insert(types.end(), sig->param_begin(), sig->param_end());
+        llvm::FunctionType *fnType = llvm::FunctionType::get(sig->getReturnType(), types, false);
+        llvm::Value *code = Builder->CreateBitCast(Builder->CreateExtractValue(closure, 0),
+                                                   fnType->getPointerTo(), "code");
+        call = Builder->CreateCall(fnType, code, argsV, "calltmp");
+    }
+    cblt::pgo::weighCall(call, site);
+
+    // holds at every opt level, the args were checked not to point into this frame
+    if (kind == sema::TailCall::MUSTTAIL) {
+        call->setTailCallKind(llvm::CallInst::TCK_MustTail);
+    }
+    return call;
+}
+
+// literals point at constant data and are never freed
+llvm::Value *StringLiteral::codegen() {
+    llvm::Constant *data = Builder->CreateGlobalStringPtr(value, "str");
+    return llvm::ConstantStruct::get(strType(), {data, Builder->getInt64(value.size())});
+}
+
+llvm::Value *ArrayLiteral::codegen() {
+    std::vector<llvm::Value *> values;
+    for (const auto &element: elements) {
+        llvm::Value *v = element->codegen();
+        if (!v) {
+            return nullptr;
+        }
+        v = convert(v, Builder->getDoubleTy());
+        if (!v) {
+            return logErrorV("array elements must be num", token.line);
+        }
+        values.push_back(v);
+    }
+
+    llvm::Value *mem = allocate(Builder->getInt64(values.size() * sizeof(double)), escapes);
+    llvm::Value *data = Builder->CreateBitCast(mem, Builder->getDoubleTy()->getPointerTo(), "data");
+    for (size_t i = 0; i < values.size(); i++) {
+        Builder->CreateStore(values[i], Builder->CreateConstInBoundsGEP1_64(Builder->getDoubleTy(), data, i));
+    }
+    return makeSlice(arrayType(), data, Builder->getInt64(values.size()));
+}
+
+// []num yields the element, str the byte as a num, maps the value for the key
+llvm::Value *IndexExpr::codegen() {
+    llvm::Value *target = left->codegen();
+    llvm::Value *idx = index->codegen();
+    if (!target || !idx) {
+        return nullptr;
+    }
+
+    if (target->getType() == mapType(false)) {
+        if (!idx->getType()->isDoubleTy()) {
+            return logErrorV("{num:num} keys must be num", token.line);
+        }
+        const llvm::FunctionCallee get = Module->getOrInsertFunction(
+            "__cblt_nummap_get", llvm::FunctionType::get(Builder->getDoubleTy(),
+                                                         {mapType(false), Builder->getDoubleTy()}, false));
+        return Builder->CreateCall(get, {target, idx}, "value");
+    }
+    if (target->getType() == mapType(true)) {
+        if (idx->getType() != strType()) {
+            return logErrorV("{str:num} keys must be str", token.line);
+        }
+        const llvm::FunctionCallee get = Module->getOrInsertFunction(
+            "__cblt_strmap_get", llvm::FunctionType::get(Builder->getDoubleTy(), {
+                                                             mapType(true), Builder->getInt8PtrTy(),
+                                                             Builder->getInt64Ty()
+                                                         }, false));
+        return Builder->CreateCall(get, {
+                                       target, Builder->CreateExtractValue(idx, 0),
+                                       Builder->CreateExtractValue(idx, 1)
+                                   }, "value");
+    }
+
+    if (target->getType() != arrayType() && target->getType() != strType()) {
+        return logErrorV("only arrays and strs can be indexed", token.line);
+    }
+    if (!idx->getType()->isDoubleTy()) {
+        return logErrorV("index must be a num", token.line);
+    }
+
+    llvm::Value *i = Builder->CreateFPToSI(idx, Builder->getInt64Ty(), "idx");
+    checkBounds(i, Builder->CreateExtractValue(target, 1, "len"));
+    llvm::Value *data = Builder->CreateExtractValue(target, 0, "data");
+    if (target->getType() == arrayType()) {
+        return Builder->CreateLoad(Builder->getDoubleTy(),
+                                   Builder->CreateInBoundsGEP(Builder->getDoubleTy(), data, i), "elem");
+    }
+    llvm::Value *byte = Builder->CreateLoad(Builder->getInt8Ty(),
+                                            Builder->CreateInBoundsGEP(Builder->getInt8Ty(), data, i), "byte");
+    return Builder->CreateUIToFP(byte, Builder->getDoubleTy(), "char");
+}
+
+// a literal whose keys and values all fold to constants, laid out exactly as
+// the runtime would have built it
+static llvm::Value *constantMap(const std::vector<std::pair<llvm::Value *, llvm::Value *>> &entries,
+                                const bool strKeys) {
+    struct Entry {
+        std::uint64_t hash;
+        llvm::Constant *key; // num key or the str data pointer
+        std::uint64_t len;
+        llvm::Constant *value;
+    };
+
+    // later duplicates win, same as inserting one by one
+    std::vector<Entry> unique;
+    std::unordered_map<std::string, size_t> seen;
+    for (const auto &[key, value]: entries) {
+        Entry entry{0, nullptr, 0, llvm::cast<llvm::Constant>(value)};
+        std::string id;
+        if (strKeys) {
+            auto *str = llvm::cast<llvm::Constant>(key);
+            entry.key = str->getAggregateElement(0u);
+            entry.len = llvm::cast<llvm::ConstantInt>(str->getAggregateElement(1u))->getZExtValue();
+            llvm::StringRef data;
+            if (!llvm::getConstantStringInfo(entry.key, data, 0, false) || data.size() < entry.len) {
+                return nullptr;
+            }
+            id = data.substr(0, entry.len).str();
+            entry.hash = cblt::rt::hashStr(id.data(), id.size());
+        } else {
+            const double num = cblt::rt::canonicalKey(
+                llvm::cast<llvm::ConstantFP>(key)->getValueAPF().convertToDouble());
+            entry.key = llvm::ConstantFP::get(Builder->getDoubleTy(), num);
+            id = std::to_string(cblt::rt::keyBits(num));
+            entry.hash = cblt::rt::hashNum(num);
+        }
+
+        if (const auto it = seen.find(id); it != seen.end()) {
+            unique[it->second].value = entry.value;
+        } else {
+            seen.emplace(id, unique.size());
+            unique.push_back(entry);
+        }
+    }
+
+    const std::uint64_t capacity = cblt::rt::capacityFor(unique.size());
+    std::vector<std::int8_t> ctrl(capacity + cblt::rt::GROUP_WIDTH, cblt::rt::CTRL_EMPTY);
+    std::vector<const Entry *> placed(capacity, nullptr);
+    for (const Entry &entry: unique) {
+        const std::uint64_t at = cblt::rt::findEmpty(ctrl.data(), capacity, entry.hash);
+        cblt::rt::setCtrl(ctrl.data(), capacity, at, cblt::rt::h2(entry.hash));
+        placed[at] = &entry;
+    }
+
+    llvm::StructType *slotType = strKeys
+                                     ? llvm::StructType::get(Context, {
+                                                                 Builder->getInt8PtrTy(), Builder->getInt64Ty(),
+                                                                 Builder->getDoubleTy()
+                                                             })
+                                     : llvm::StructType::get(Context, {Builder->getDoubleTy(), Builder->getDoubleTy()});
+    std::vector<llvm::Constant *> slots;
+    for (const Entry *entry: placed) {
+        if (!entry) {
+            slots.push_back(llvm::Constant::getNullValue(slotType));
+        } else if (strKeys) {
+            slots.push_back(llvm::ConstantStruct::get(slotType, {entry->key, Builder->getInt64(entry->len), entry->value}));
+        } else {
+            slots.push_back(llvm::ConstantStruct::get(slotType, {entry->key, entry->value}));
+        }
+    }
+
+    // nothing inserts into a literal after it's made, so all of it is read only
+    auto *ctrlInit = llvm::ConstantDataArray::get(
+        Context, llvm::makeArrayRef(reinterpret_cast<const std::uint8_t *>(ctrl.data()), ctrl.size()));
+    auto *ctrlGv = new llvm::GlobalVariable(*Module, ctrlInit->getType(), true, llvm::GlobalValue::PrivateLinkage,
+                                            ctrlInit, "map.ctrl");
+    ctrlGv->setAlignment(llvm::Align(cblt::rt::GROUP_WIDTH));
+    auto *slotsType = llvm::ArrayType::get(slotType, capacity);
+    auto *slotsGv = new llvm::GlobalVariable(*Module, slotsType, true, llvm::GlobalValue::PrivateLinkage,
+                                             llvm::ConstantArray::get(slotsType, slots), "map.slots");
+
+    llvm::StructType *headerType = llvm::StructType::get(Context, {
+                                                             Builder->getInt8PtrTy(), Builder->getInt8PtrTy(),
+                                                             Builder->getInt64Ty(), Builder->getInt64Ty(),
+                                                             Builder->getInt64Ty()
+                                                         });
+    auto *header = llvm::ConstantStruct::get(headerType, {
+                                                 llvm::ConstantExpr::getBitCast(ctrlGv, Builder->getInt8PtrTy()),
+                                                 llvm::ConstantExpr::getBitCast(slotsGv, Builder->getInt8PtrTy()),
+                                                 Builder->getInt64(capacity),
+                                                 Builder->getInt64(unique.size()),
+                                                 Builder->getInt64(cblt::rt::growthFor(capacity) - unique.size())
+                                             });
+    auto *headerGv = new llvm::GlobalVariable(*Module, headerType, true, llvm::GlobalValue::PrivateLinkage, header,
+                                              "map");
+    return llvm::ConstantExpr::getBitCast(headerGv, mapType(strKeys));
+}
+
+// {k: v, ...} with str or num keys and num values
+llvm::Value *HashLiteral::codegen() {
+    if (pairs.empty()) {
+        return logErrorV("empty map literal, its key type is unknown", token.line);
+    }
+
+    std::vector<std::pair<llvm::Value *, llvm::Value *>> entries;
+    bool constant = true;
+    for (const auto &[key, value]: pairs) {
+        llvm::Value *k = key->codegen();
+        llvm::Value *v = value->codegen();
+        if (!k || !v) {
+            return nullptr;
+        }
+        if (k->getType() != Builder->getDoubleTy() && k->getType() != strType()) {
+            return logErrorV("map keys must be num or str", token.line);
+        }
+        if (!entries.empty() && k->getType() != entries.front().first->getType()) {
+            return logErrorV("map keys must all have the same type", token.line);
+        }
+        v = convert(v, Builder->getDoubleTy());
+        if (!v) {
+            return logErrorV("map values must be num", token.line);
+        }
+        constant = constant && llvm::isa<llvm::Constant>(k) && llvm::isa<llvm::Constant>(v);
+        entries.emplace_back(k, v);
+    }
+
+    const bool strKeys = entries.front().first->getType() == strType();
+    if (constant) {
+        if (llvm::Value *map = constantMap(entries, strKeys)) {
+            return map;
+        }
+    }
+
+    llvm::PointerType *ty = mapType(strKeys);
+    const llvm::FunctionCallee newMap = Module->getOrInsertFunction(
+        strKeys ? "__cblt_strmap_new" : "__cblt_nummap_new", llvm::FunctionType::get(ty, {Builder->getInt64Ty()}, false));
+    llvm::Value *map = Builder->CreateCall(newMap, {Builder->getInt64(entries.size())}, "map");
+    if (strKeys) {
+        const llvm::FunctionCallee insert = Module->getOrInsertFunction(
+            "__cblt_strmap_insert", llvm::FunctionType::get(Builder->getVoidTy(), {
+                                                                ty, Builder->getInt8PtrTy(), Builder->getInt64Ty(),
+                                                                Builder->getDoubleTy()
+                                                            }, false));
+        for (const auto &[k, v]: entries) {
+            Builder->CreateCall(insert, {map, Builder->CreateExtractValue(k, 0), Builder->CreateExtractValue(k, 1), v});
+        }
+    } else {
+        const llvm::FunctionCallee insert = Module->getOrInsertFunction(
+            "__cblt_nummap_insert", llvm::FunctionType::get(Builder->getVoidTy(), {
+                                                                ty, Builder->getDoubleTy(), Builder->getDoubleTy()
+                                                            }, false));
+        for (const auto &[k, v]: entries) {
+            Builder->CreateCall(insert, {map, k, v});
+        }
+    }
+    return map;
+}
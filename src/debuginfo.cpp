@@ -0,0 +1,97 @@
+#include "h/debuginfo.h"
+#include "h/cobalt.h"
+#include "llvm/BinaryFormat/Dwarf.h"
+#include "llvm/IR/DIBuilder.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+
+using namespace cblt::globals;
+
+namespace cblt::debug {
+    struct Scope {
+        llvm::DISubprogram *subprogram;
+        llvm::DebugLoc outer; // builder location of the enclosing fnc, put back on leave
+    };
+
+    static thread_local bool on = true;
+    static thread_local bool optimizedUnit = false;
+    static thread_local std::unique_ptr<llvm::DIBuilder> dib;
+    static thread_local llvm::DIFile *file = nullptr;
+    static thread_local llvm::DISubroutineType *fncType = nullptr;
+    static thread_local std::vector<Scope> scopes; // innermost fnc being generated is last
+
+    void setEnabled(const bool enable) {
+        on = enable;
+    }
+
+    bool enabled() {
+        return on;
+    }
+
+    void beginModule(llvm::Module &module, const std::string &path, const bool optimized) {
+        dib.reset();
+        scopes.clear();
+        if (!on) {
+            return;
+        }
+
+        llvm::SmallString<256> absolute(path);
+        llvm::sys::fs::make_absolute(absolute);
+        dib = std::make_unique<llvm::DIBuilder>(module);
+        file = dib->createFile(llvm::sys::path::filename(absolute), llvm::sys::path::parent_path(absolute));
+        // there is no dwarf language code for cobalt, C is what tools fall back on best
+        dib->createCompileUnit(llvm::dwarf::DW_LANG_C, file, "cobalt", optimized, "", 0, "",
+                               llvm::DICompileUnit::LineTablesOnly);
+        // line tables don't describe types, every fnc shares an empty signature
+        fncType = dib->createSubroutineType(dib->getOrCreateTypeArray({}));
+        optimizedUnit = optimized;
+    }
+
+    void enterFunction(llvm::Function *fn, const int line) {
+        if (!dib) {
+            return;
+        }
+        llvm::DISubprogram::DISPFlags flags = llvm::DISubprogram::SPFlagDefinition;
+        if (optimizedUnit) {
+            flags |= llvm::DISubprogram::SPFlagOptimized;
+        }
+        if (fn->hasLocalLinkage()) {
+            flags |= llvm::DISubprogram::SPFlagLocalToUnit;
+        }
+        const unsigned at = line > 0 ? line : 0;
+        llvm::DISubprogram *sp = dib->createFunction(file, fn->getName(), fn->getName(), file, at, fncType, at,
+                                                     llvm::DINode::FlagPrototyped, flags);
+        fn->setSubprogram(sp);
+        // perf's default call graphs walk frame pointers
+        fn->addFnAttr("frame-pointer", "all");
+
+        scopes.push_back({sp, Builder->getCurrentDebugLocation()});
+        setLine(line);
+    }
+
+    void leaveFunction() {
+        if (!dib || scopes.empty()) {
+            return;
+        }
+        dib->finalizeSubprogram(scopes.back().subprogram);
+        Builder->SetCurrentDebugLocation(scopes.back().outer);
+        scopes.pop_back();
+    }
+
+    void setLine(const int line) {
+        if (!dib || scopes.empty() || line <= 0) {
+            return;
+        }
+        Builder->SetCurrentDebugLocation(llvm::DILocation::get(Context, line, 0, scopes.back().subprogram));
+    }
+
+    void finishModule(llvm::Module &module) {
+        if (!dib) {
+            return;
+        }
+        dib->finalize();
+        module.addModuleFlag(llvm::Module::Warning, "Debug Info Version", llvm::DEBUG_METADATA_VERSION);
+        module.addModuleFlag(llvm::Module::Warning, "Dwarf Version", 4);
+        dib.reset();
+    }
+} // cblt::debug
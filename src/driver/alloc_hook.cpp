@@ -0,0 +1,73 @@
+#include "../h/alloc.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <sys/resource.h>
+
+// counting replacement for the global allocation functions
+// array and nothrow forms forward here through the standard library
+namespace cblt::alloc {
+    // written by the measuring compile, read by every operator new in the process
+    static std::atomic<bool> tracking{false};
+    // only the measuring compile's threads count, a daemon's other requests don't
+    static thread_local bool measuring = false;
+    static thread_local std::uint64_t allocCount = 0;
+    static thread_local std::uint64_t allocBytes = 0;
+
+    void enableTracking() {
+        tracking.store(true, std::memory_order_relaxed);
+        measuring = true;
+    }
+
+    void joinTracking() {
+        measuring = tracking.load(std::memory_order_relaxed);
+    }
+
+    void disableTracking() {
+        tracking.store(false, std::memory_order_relaxed);
+        measuring = false;
+    }
+
+    bool trackingEnabled() {
+        return tracking.load(std::memory_order_relaxed);
+    }
+
+    std::uint64_t threadAllocCount() {
+        return allocCount;
+    }
+
+    std::uint64_t threadAllocBytes() {
+        return allocBytes;
+    }
+
+    std::uint64_t peakRssBytes() {
+        rusage usage{};
+        if (getrusage(RUSAGE_SELF, &usage) != 0) {
+            return 0;
+        }
+#ifdef __APPLE__
+        return static_cast<std::uint64_t>(usage.ru_maxrss); // bytes on darwin
+#else
+        return static_cast<std::uint64_t>(usage.ru_maxrss) * 1024; // kilobytes on linux
+#endif
+    }
+} // cblt::alloc
+
+void *operator new(std::size_t size) {
+    if (cblt::alloc::measuring && cblt::alloc::tracking.load(std::memory_order_relaxed)) {
+        ++cblt::alloc::allocCount;
+        cblt::alloc::allocBytes += size;
+    }
+    if (void *ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
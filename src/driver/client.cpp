@@ -0,0 +1,53 @@
+// CobaltClient, takes the same command line as Cobalt and has a running
+// Cobalt --daemon do the compile. without a daemon it runs Cobalt itself
+#include "../h/daemon.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static int runLocally(char **argv) {
+    argv[0] = const_cast<char *>("Cobalt");
+    execvp(argv[0], argv);
+    std::fprintf(stderr, "CobaltClient: no daemon and could not run Cobalt: %s\n", std::strerror(errno));
+    return 1;
+}
+
+int main(const int argc, char **argv) {
+    const std::string path = cblt::daemon::defaultSocketPath();
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        return runLocally(argv);
+    }
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+        return runLocally(argv);
+    }
+
+    char cwd[4096];
+    if (!getcwd(cwd, sizeof(cwd))) {
+        std::fprintf(stderr, "CobaltClient: getcwd: %s\n", std::strerror(errno));
+        return 1;
+    }
+    bool sent = cblt::daemon::writeString(fd, cwd) && cblt::daemon::writeU32(fd, argc - 1);
+    for (int i = 1; sent && i < argc; i++) {
+        sent = cblt::daemon::writeString(fd, argv[i]);
+    }
+
+    std::uint32_t rc;
+    std::string diag;
+    std::string output; // -o -
+    if (!sent || !cblt::daemon::readU32(fd, rc) || !cblt::daemon::readString(fd, diag) ||
+        !cblt::daemon::readString(fd, output)) {
+        std::fprintf(stderr, "CobaltClient: lost the connection to the daemon at %s\n", path.c_str());
+        return 1;
+    }
+    std::fwrite(diag.data(), 1, diag.size(), stderr);
+    std::fwrite(output.data(), 1, output.size(), stdout);
+    return static_cast<int>(rc);
+}
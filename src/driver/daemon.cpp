@@ -0,0 +1,274 @@
+#include "../h/daemon.h"
+#include "../h/driver.h"
+#include "llvm/Support/TargetSelect.h"
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <semaphore>
+#include <shared_mutex>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+namespace cblt::daemon {
+    static std::string listeningPath; // unlinked again when the daemon is stopped
+    // --time-report, --trace and --mem-report measure the whole process, so
+    // those compiles run alone
+    static std::shared_mutex reportLock;
+    static std::counting_semaphore<> *compileSlots; // one compile per core, the rest queue
+
+    // finished outputs by everything that went into them, so a build that
+    // asks again for an unchanged file gets the bytes back without llvm
+    struct CachedOutput {
+        std::string bytes;
+        std::string diag; // warnings are replayed too
+    };
+
+    static constexpr std::size_t CACHE_LIMIT = 256 << 20;
+    static std::mutex cacheLock;
+    static std::unordered_map<std::string, CachedOutput> cache;
+    static std::deque<std::string> cacheOrder; // oldest first, evicted past CACHE_LIMIT
+    static std::size_t cacheBytes = 0;
+
+    static void onStop(int) {
+        unlink(listeningPath.c_str());
+        _exit(0);
+    }
+
+    // paths the compiler opens are relative to the client's directory. the
+    // profile paths are baked into the program and stay relative to wherever
+    // it runs, like they are without the daemon. - is the client's stdout
+    static void resolvePaths(driver::Options &opts, const std::string &cwd) {
+        for (std::string *path: {&opts.input, &opts.output, &opts.traceFile, &opts.memReportFile, &opts.profileUse}) {
+            if (!path->empty() && (*path)[0] != '/' && *path != "-") {
+                *path = cwd + "/" + *path;
+            }
+        }
+    }
+
+    static bool readFile(const std::string &path, std::string &out) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            return false;
+        }
+        out.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        return true;
+    }
+
+    // the command line, where it ran, and the contents of every file the
+    // compile reads
+    static bool cacheKey(const driver::Options &opts, const std::string &cwd, const std::vector<std::string> &args,
+                         std::string &key) {
+        key = cwd;
+        for (const std::string &arg: args) {
+            key += '\0' + arg;
+        }
+        std::string contents;
+        if (!readFile(opts.input, contents)) {
+            return false;
+        }
+        key += '\0' + contents;
+        if (!opts.profileUse.empty()) {
+            if (!readFile(opts.profileUse, contents)) {
+                return false;
+            }
+            key += '\0' + contents;
+        }
+        return true;
+    }
+
+    static bool replay(const std::string &key, const std::string &output, std::string &diag) {
+        std::string bytes;
+        {
+            std::lock_guard guard(cacheLock);
+            const auto it = cache.find(key);
+            if (it == cache.end()) {
+                return false;
+            }
+            bytes = it->second.bytes;
+            diag = it->second.diag;
+        }
+        std::ofstream out(output, std::ios::binary | std::ios::trunc);
+        out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        return static_cast<bool>(out);
+    }
+
+    static void remember(const std::string &key, const std::string &output, const std::string &diag) {
+        CachedOutput entry;
+        if (!readFile(output, entry.bytes)) {
+            return;
+        }
+        entry.diag = diag;
+        const std::size_t size = key.size() + entry.bytes.size() + diag.size();
+        if (size > CACHE_LIMIT / 4) {
+            return;
+        }
+
+        std::lock_guard guard(cacheLock);
+        if (!cache.emplace(key, std::move(entry)).second) {
+            return;
+        }
+        cacheOrder.push_back(key);
+        cacheBytes += size;
+        while (cacheBytes > CACHE_LIMIT) {
+            const auto it = cache.find(cacheOrder.front());
+            cacheBytes -= it->first.size() + it->second.bytes.size() + it->second.diag.size();
+            cache.erase(it);
+            cacheOrder.pop_front();
+        }
+    }
+
+    static int compile(driver::Options &opts, const std::string &cwd, const std::vector<std::string> &args,
+                       std::string &diagText) {
+        const bool measuring = opts.timeReport || !opts.traceFile.empty() || !opts.memReportFile.empty();
+        std::string key;
+        if (!measuring && cacheKey(opts, cwd, args, key) && replay(key, opts.output, diagText)) {
+            return 0;
+        }
+
+        std::ostringstream diag;
+        compileSlots->acquire();
+        int rc;
+        if (measuring) {
+            std::unique_lock lock(reportLock);
+            rc = driver::compile(opts, diag);
+        } else {
+            std::shared_lock lock(reportLock);
+            rc = driver::compile(opts, diag);
+        }
+        compileSlots->release();
+        diagText = diag.str();
+        if (rc == 0 && !key.empty()) {
+            remember(key, opts.output, diagText);
+        }
+        return rc;
+    }
+
+    // output is what -o - wrote, for the client to copy to its stdout
+    static int runRequest(const std::string &cwd, std::vector<std::string> &args, std::string &diagText,
+                          std::string &output) {
+        std::vector<char *> argv{const_cast<char *>("Cobalt")};
+        for (std::string &arg: args) {
+            argv.push_back(arg.data());
+        }
+
+        driver::Options opts;
+        std::string err;
+        if (!driver::parseArgs(static_cast<int>(argv.size()), argv.data(), opts, err)) {
+            diagText = err + '\n' + driver::usage();
+            return 1;
+        }
+        resolvePaths(opts, cwd);
+        if (opts.output != "-") {
+            return compile(opts, cwd, args, diagText);
+        }
+
+        // the daemon's own stdout is nobody's, write to a file and send it back
+        char path[] = "/tmp/cobalt-stdout-XXXXXX";
+        const int fd = mkstemp(path);
+        if (fd < 0) {
+            diagText = std::string("Daemon error: no temporary file for -o -: ") + std::strerror(errno) + '\n';
+            return 1;
+        }
+        close(fd);
+        opts.output = path;
+        int rc = compile(opts, cwd, args, diagText);
+        if (rc == 0 && !readFile(path, output)) {
+            diagText += "Daemon error: could not read back the output for -o -\n";
+            rc = 1;
+        }
+        unlink(path);
+        return rc;
+    }
+
+    // runs on its own thread, so the thread_local codegen state in cobalt.h
+    // is fresh for every request and gone when it finishes
+    static void handle(const int fd) {
+        std::string cwd;
+        std::uint32_t argc;
+        if (!readString(fd, cwd) || !readU32(fd, argc)) {
+            close(fd);
+            return;
+        }
+        std::vector<std::string> args(argc);
+        for (std::string &arg: args) {
+            if (!readString(fd, arg)) {
+                close(fd);
+                return;
+            }
+        }
+
+        std::string diag;
+        std::string output;
+        const int rc = runRequest(cwd, args, diag, output);
+        if (writeU32(fd, static_cast<std::uint32_t>(rc)) && writeString(fd, diag)) {
+            writeString(fd, output);
+        }
+        close(fd);
+    }
+
+    int serve(const std::string &socketPath) {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (socketPath.size() >= sizeof(addr.sun_path)) {
+            std::cerr << "Daemon error: socket path too long: " << socketPath << '\n';
+            return 1;
+        }
+        std::memcpy(addr.sun_path, socketPath.c_str(), socketPath.size() + 1);
+
+        // a socket file nobody answers on was left by a daemon that died
+        const int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        const bool taken = probe >= 0 && connect(probe, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0;
+        close(probe);
+        if (taken) {
+            std::cerr << "Daemon error: a daemon is already listening on " << socketPath << '\n';
+            return 1;
+        }
+        unlink(socketPath.c_str());
+
+        const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            std::cerr << "Daemon error: socket: " << std::strerror(errno) << '\n';
+            return 1;
+        }
+        if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0) {
+            std::cerr << "Daemon error: could not listen on " << socketPath << ": " << std::strerror(errno) << '\n';
+            close(fd);
+            return 1;
+        }
+        listeningPath = socketPath;
+        std::signal(SIGINT, onStop);
+        std::signal(SIGTERM, onStop);
+        std::signal(SIGPIPE, SIG_IGN); // a client that went away shows up as a failed write
+
+        // target registration is what a cold compile pays for before anything
+        // else, do it once before the first request
+        llvm::InitializeNativeTarget();
+        llvm::InitializeNativeTargetAsmPrinter();
+        const unsigned cores = std::thread::hardware_concurrency();
+        compileSlots = new std::counting_semaphore<>(cores ? cores : 1);
+        std::cerr << "cobalt daemon listening on " << socketPath << '\n';
+
+        for (;;) {
+            const int client = accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) {
+                    continue;
+                }
+                std::cerr << "Daemon error: accept: " << std::strerror(errno) << '\n';
+                unlink(socketPath.c_str());
+                return 1;
+            }
+            std::thread(handle, client).detach();
+        }
+    }
+} // cblt::daemon
@@ -0,0 +1,533 @@
+#include "../h/driver.h"
+#include "../h/alloc.h"
+#include "../h/cobalt.h"
+#include "../h/debuginfo.h"
+#include "../h/memstats.h"
+#include "../h/parser.h"
+#include "../h/pgo.h"
+#include "../h/profiler.h"
+#include "../h/sema.h"
+#include "../h/timing.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_os_ostream.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Target/TargetOptions.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <sstream>
+#include <thread>
+
+using namespace cblt::globals;
+
+namespace cblt::driver {
+    static void printErrors(std::ostream &diag, const std::vector<std::string> &errors) {
+        for (const auto &err: errors) {
+            diag << err << '\n';
+        }
+    }
+
+    const char *usage() {
+        return "usage: Cobalt [-O0..-O3] [-o out] [--emit-llvm] [--time-report] [--trace=out.json]\n"
+               "              [--mem-report=out.json] [-fprofile-generate[=path] | -fprofile-use=path]\n"
+               "              [--profile[=path]] [-Wnon-tail-recursion] [-g0] [--stream] file.cblt\n"
+               "       Cobalt --daemon[=socket]\n";
+    }
+
+    static std::string replaceExtension(const std::string &path, const std::string &ext) {
+        const size_t slash = path.find_last_of('/');
+        const size_t dot = path.find_last_of('.');
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+            return path + ext;
+        }
+        return path.substr(0, dot) + ext;
+    }
+
+    bool parseArgs(const int argc, char **argv, Options &opts, std::string &err) {
+        for (int i = 1; i < argc; i++) {
+            const std::string arg = argv[i];
+            if (arg == "--time-report") {
+                opts.timeReport = true;
+            } else if (arg.rfind("--trace=", 0) == 0) {
+                opts.traceFile = arg.substr(8);
+                if (opts.traceFile.empty()) {
+                    err = "Driver error: --trace needs a file name";
+                    return false;
+                }
+            } else if (arg.rfind("--mem-report=", 0) == 0) {
+                opts.memReportFile = arg.substr(13);
+                if (opts.memReportFile.empty()) {
+                    err = "Driver error: --mem-report needs a file name";
+                    return false;
+                }
+            } else if (arg == "-fprofile-generate") {
+                opts.profileGenerate = "default.cblprof";
+            } else if (arg.rfind("-fprofile-generate=", 0) == 0) {
+                opts.profileGenerate = arg.substr(19);
+            } else if (arg.rfind("-fprofile-use=", 0) == 0) {
+                opts.profileUse = arg.substr(14);
+            } else if (arg == "--profile") {
+                opts.profile = "cobalt.profile";
+            } else if (arg.rfind("--profile=", 0) == 0) {
+                opts.profile = arg.substr(10);
+                if (opts.profile.empty()) {
+                    err = "Driver error: --profile needs a file name";
+                    return false;
+                }
+            } else if (arg == "-Wnon-tail-recursion") {
+                opts.warnNonTailRecursion = true;
+            } else if (arg == "-g0") {
+                opts.debugInfo = false;
+            } else if (arg == "--stream") {
+                opts.stream = true;
+            } else if (arg == "--emit-llvm") {
+                opts.emitLLVM = true;
+            } else if (arg.size() == 3 && arg[0] == '-' && arg[1] == 'O' && arg[2] >= '0' && arg[2] <= '3') {
+                opts.optLevel = arg[2] - '0';
+            } else if (arg == "-o") {
+                if (i + 1 >= argc) {
+                    err = "Driver error: -o needs a file name";
+                    return false;
+                }
+                opts.output = argv[++i];
+            } else if (!arg.empty() && arg[0] == '-') {
+                err = "Driver error: unknown option " + arg;
+                return false;
+            } else if (opts.input.empty()) {
+                opts.input = arg;
+            } else {
+                err = "Driver error: more than one input file given";
+                return false;
+            }
+        }
+
+        if (opts.input.empty()) {
+            err = "Driver error: no input file";
+            return false;
+        }
+        if (!opts.profileGenerate.empty() && !opts.profileUse.empty()) {
+            err = "Driver error: -fprofile-generate and -fprofile-use are exclusive";
+            return false;
+        }
+        if (opts.output.empty()) {
+            opts.output = replaceExtension(opts.input, opts.emitLLVM ? ".ll" : ".o");
+        }
+        return true;
+    }
+
+    static bool readFile(const std::string &path, std::string &out) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            return false;
+        }
+        std::ostringstream ss;
+        ss << file.rdbuf();
+        out = ss.str();
+        return true;
+    }
+
+    static std::unique_ptr<llvm::TargetMachine> createTargetMachine(const int optLevel, std::string &err) {
+        llvm::InitializeNativeTarget();
+        llvm::InitializeNativeTargetAsmPrinter();
+
+        const std::string triple = llvm::sys::getDefaultTargetTriple();
+        const llvm::Target *target = llvm::TargetRegistry::lookupTarget(triple, err);
+        if (!target) {
+            err = "Driver error: " + err;
+            return nullptr;
+        }
+
+        const llvm::CodeGenOpt::Level level = optLevel == 0 ? llvm::CodeGenOpt::None
+                                              : optLevel == 1 ? llvm::CodeGenOpt::Less
+                                              : optLevel == 2 ? llvm::CodeGenOpt::Default
+                                              : llvm::CodeGenOpt::Aggressive;
+        std::unique_ptr<llvm::TargetMachine> tm(target->createTargetMachine(
+            triple, llvm::sys::getHostCPUName(), "", llvm::TargetOptions(), llvm::Reloc::PIC_));
+        tm->setOptLevel(level);
+        return tm;
+    }
+
+    static void optimize(llvm::Module &module, llvm::TargetMachine *tm, const int optLevel) {
+        llvm::LoopAnalysisManager lam;
+        llvm::FunctionAnalysisManager fam;
+        llvm::CGSCCAnalysisManager cgam;
+        llvm::ModuleAnalysisManager mam;
+
+        // pass managers open a time trace span per pass and ir unit,
+        // giving the per function optimization spans in --trace output
+        llvm::PassBuilder pb(tm);
+        pb.registerModuleAnalyses(mam);
+        pb.registerCGSCCAnalyses(cgam);
+        pb.registerFunctionAnalyses(fam);
+        pb.registerLoopAnalyses(lam);
+        pb.crossRegisterProxies(lam, fam, cgam, mam);
+
+        llvm::ModulePassManager mpm;
+        switch (optLevel) {
+            case 0: mpm = pb.buildO0DefaultPipeline(llvm::OptimizationLevel::O0); break;
+            case 1: mpm = pb.buildPerModuleDefaultPipeline(llvm::OptimizationLevel::O1); break;
+            case 2: mpm = pb.buildPerModuleDefaultPipeline(llvm::OptimizationLevel::O2); break;
+            default: mpm = pb.buildPerModuleDefaultPipeline(llvm::OptimizationLevel::O3); break;
+        }
+        mpm.run(module, mam);
+    }
+
+    static bool emit(llvm::Module &module, llvm::TargetMachine *tm, const Options &opts, std::string &err) {
+        std::error_code ec;
+        llvm::raw_fd_ostream dest(opts.output, ec, llvm::sys::fs::OF_None);
+        if (ec) {
+            err = "Driver error: could not open " + opts.output + ": " + ec.message();
+            return false;
+        }
+
+        if (opts.emitLLVM) {
+            module.print(dest, nullptr);
+            return true;
+        }
+
+        llvm::legacy::PassManager pm;
+        if (tm->addPassesToEmitFile(pm, dest, nullptr, llvm::CGFT_ObjectFile)) {
+            err = "Driver error: target can't emit an object file";
+            return false;
+        }
+        pm.run(module);
+        dest.flush();
+        return true;
+    }
+
+    // module, builder and per compile codegen options, on the thread that
+    // will generate the code since that state is thread_local
+    static bool beginModule(const Options &opts, const llvm::TargetMachine &tm, std::ostream &diag) {
+        Module = std::make_unique<llvm::Module>(opts.input, Context);
+        Module->setTargetTriple(tm.getTargetTriple().str());
+        Module->setDataLayout(tm.createDataLayout());
+        Builder = std::make_unique<llvm::IRBuilder<>>(Context);
+        NamedValues.clear();
+        Errors.clear();
+        debug::setEnabled(opts.debugInfo);
+        if (!opts.profile.empty()) {
+            profiler::enable(opts.profile);
+        }
+        debug::beginModule(*Module, opts.input, opts.optLevel > 0);
+        std::string err;
+        if (!opts.profileGenerate.empty()) {
+            pgo::enableGenerate(opts.profileGenerate);
+        } else if (!opts.profileUse.empty() && !pgo::enableUse(opts.profileUse, err)) {
+            diag << err << '\n';
+            return false;
+        }
+        return true;
+    }
+
+    // codegen errors, then verify, optimize and emit
+    static int finishModule(const Options &opts, llvm::TargetMachine &tm, std::ostream &diag) {
+        if (!Errors.empty()) {
+            printErrors(diag, Errors);
+            return 1;
+        }
+        llvm::raw_os_ostream verifyOut(diag);
+        if (llvm::verifyModule(*Module, &verifyOut)) {
+            diag << "Codegen error: generated module is invalid\n";
+            return 1;
+        }
+
+        {
+            timing::PhaseScope scope(timing::Phase::OPT);
+            optimize(*Module, &tm, opts.optLevel);
+            profiler::instrument(*Module);
+        }
+
+        {
+            timing::PhaseScope scope(timing::Phase::EMIT);
+            std::string err;
+            if (!emit(*Module, &tm, opts, err)) {
+                diag << err << '\n';
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    static int runWhole(const Options &opts, std::ostream &diag, memstats::Report &memReport,
+                        const lex::Lexer &lexer, parse::Parser &parser) {
+        std::unique_ptr<ast::Program> program;
+        {
+            timing::PhaseScope scope(timing::Phase::PARSE);
+            program = parser.parseProgram();
+        }
+        if (memstats::enabled()) {
+            memstats::countAst(*program, memReport.astKinds);
+        }
+        if (!lexer.getErrors().empty() || !parser.getErrors().empty()) {
+            printErrors(diag, lexer.getErrors());
+            printErrors(diag, parser.getErrors());
+            return 1;
+        }
+
+        {
+            timing::PhaseScope scope(timing::Phase::SEMA);
+            sema::analyzeEscapes(*program);
+            if (opts.warnNonTailRecursion) {
+                printErrors(diag, sema::checkTailRecursion(*program));
+            }
+        }
+
+        std::string err;
+        const std::unique_ptr<llvm::TargetMachine> tm = createTargetMachine(opts.optLevel, err);
+        if (!tm) {
+            diag << err << '\n';
+            return 1;
+        }
+        if (!beginModule(opts, *tm, diag)) {
+            return 1;
+        }
+        {
+            timing::PhaseScope scope(timing::Phase::IRGEN);
+            program->codegen();
+            pgo::finishModule(*Module);
+            debug::finishModule(*Module);
+        }
+        return finishModule(opts, *tm, diag);
+    }
+
+    // statements on their way from the parser to the codegen thread, the
+    // bound keeps the parser from running ahead so few are alive at once
+    template<typename T>
+    class BoundedQueue {
+        std::mutex lock;
+        std::condition_variable notEmpty, notFull;
+        std::deque<T> items;
+        const std::size_t capacity;
+        bool closed = false;
+
+    public:
+        explicit BoundedQueue(const std::size_t capacity) : capacity(capacity) {
+        }
+
+        // false once the queue was closed, the consumer gave up
+        bool push(T item) {
+            std::unique_lock guard(lock);
+            notFull.wait(guard, [this] { return closed || items.size() < capacity; });
+            if (closed) {
+                return false;
+            }
+            items.push_back(std::move(item));
+            notEmpty.notify_one();
+            return true;
+        }
+
+        // nullopt once the queue is closed and drained
+        std::optional<T> pop() {
+            std::unique_lock guard(lock);
+            notEmpty.wait(guard, [this] { return closed || !items.empty(); });
+            if (items.empty()) {
+                return std::nullopt;
+            }
+            T item = std::move(items.front());
+            items.pop_front();
+            notFull.notify_one();
+            return item;
+        }
+
+        void close() {
+            std::lock_guard guard(lock);
+            closed = true;
+            notEmpty.notify_all();
+            notFull.notify_all();
+        }
+    };
+
+    static constexpr std::size_t STREAM_DEPTH = 16;
+    using StmtQueue = BoundedQueue<std::unique_ptr<ast::Stmt>>;
+
+    // the codegen thread of a streaming compile, owns all of the llvm state
+    // and frees each statement once it's lowered
+    static int lowerStream(const Options &opts, std::ostream &diag, const std::vector<ast::FuncLiteral *> &fncs,
+                           std::set<std::string> assigned, StmtQueue &queue,
+                           const std::atomic<bool> &parseFailed) {
+        timing::ThreadScope thread("codegen");
+        std::string err;
+        const std::unique_ptr<llvm::TargetMachine> tm = createTargetMachine(opts.optLevel, err);
+        if (!tm) {
+            diag << err << '\n';
+        }
+        int rc = 1;
+        if (tm && beginModule(opts, *tm, diag)) {
+            {
+                timing::PhaseScope scope(timing::Phase::IRGEN);
+                std::optional<std::unique_ptr<ast::Stmt>> stmt = queue.pop();
+                ast::beginMain(fncs, std::move(assigned), stmt ? (*stmt)->TokenLine() : 1);
+                for (; stmt; stmt = queue.pop()) {
+                    ast::lowerTopLevel(**stmt);
+                }
+                ast::finishMain();
+                pgo::finishModule(*Module);
+                debug::finishModule(*Module);
+            }
+            // the parser's errors are reported instead
+            if (!parseFailed) {
+                rc = finishModule(opts, *tm, diag);
+            }
+        }
+        // stops the parser early when setup failed
+        queue.close();
+
+        // this thread's codegen state goes with it, the module before its context
+        NamedValues.clear();
+        Errors.clear();
+        Builder.reset();
+        Module.reset();
+        return rc;
+    }
+
+    // --stream, parse and codegen overlap and only the statements in flight
+    // are alive. one pass over the tokens finds the top level fnc signatures
+    // and the assigned names up front, then each statement is parsed once,
+    // handed over and its tokens freed. a parse error stops the handing over,
+    // the rest is still parsed for its errors and nothing is written
+    static int runStreaming(const Options &opts, std::ostream &diag, memstats::Report &memReport,
+                            const lex::Lexer &lexer, parse::Parser &parser) {
+        if (!lexer.getErrors().empty()) {
+            printErrors(diag, lexer.getErrors());
+            return 1;
+        }
+        parse::Parser::Outline outline;
+        {
+            timing::PhaseScope scope(timing::Phase::PARSE);
+            outline = parser.outline();
+        }
+        std::vector<ast::FuncLiteral *> fncs;
+        for (const auto &func: outline.fncs) {
+            fncs.push_back(func.get());
+        }
+
+        StmtQueue queue(STREAM_DEPTH);
+        std::atomic<bool> parseFailed{false};
+        std::ostringstream codegenDiag;
+        int rc = 1;
+        std::thread codegen([&] {
+            rc = lowerStream(opts, codegenDiag, fncs, std::move(outline.assigned), queue, parseFailed);
+        });
+
+        sema::EscapeStream escapes;
+        sema::TailRecursionCheck tailCheck(fncs);
+        {
+            timing::PhaseScope scope(timing::Phase::PARSE);
+            bool handing = true;
+            while (auto stmt = parser.parseNext()) {
+                parser.dropParsed();
+                if (handing && !parser.getErrors().empty()) {
+                    // set before the close, lowerStream reads it once the queue is drained
+                    parseFailed = true;
+                    queue.close();
+                    handing = false;
+                }
+                if (!handing) {
+                    continue;
+                }
+                if (memstats::enabled()) {
+                    memstats::countAst(*stmt, memReport.astKinds);
+                }
+                {
+                    timing::PhaseScope semaScope(timing::Phase::SEMA, false);
+                    escapes.add(*stmt);
+                    if (opts.warnNonTailRecursion) {
+                        tailCheck.add(*stmt);
+                    }
+                }
+                if (!queue.push(std::move(stmt))) {
+                    break;
+                }
+            }
+            if (!parser.getErrors().empty()) {
+                parseFailed = true;
+            }
+        }
+        queue.close();
+        codegen.join();
+
+        if (parseFailed) {
+            printErrors(diag, parser.getErrors());
+            return 1;
+        }
+        if (opts.warnNonTailRecursion) {
+            printErrors(diag, tailCheck.finish());
+        }
+        diag << codegenDiag.str();
+        return rc;
+    }
+
+    static int runPipeline(const Options &opts, std::ostream &diag, memstats::Report &memReport) {
+        std::string source;
+        {
+            timing::PhaseScope scope(timing::Phase::READ);
+            if (!readFile(opts.input, source)) {
+                diag << "Driver error: could not read " << opts.input << '\n';
+                return 1;
+            }
+        }
+
+        lex::Lexer lexer(std::move(source));
+        parse::Parser parser(lexer);
+        if (memstats::enabled()) {
+            memReport.sourceBytes = lexer.getInputSize();
+            memReport.tokenCount = lexer.getTokenCount();
+            memReport.tokenBytes = lexer.getTokenBytes();
+        }
+        if (opts.stream) {
+            return runStreaming(opts, diag, memReport, lexer, parser);
+        }
+        return runWhole(opts, diag, memReport, lexer, parser);
+    }
+
+    int compile(const Options &opts, std::ostream &diag) {
+        // a daemon runs one measuring compile at a time, alone
+        const bool measuring = opts.timeReport || !opts.memReportFile.empty();
+        if (opts.timeReport) {
+            alloc::enableTracking();
+            timing::enableReport();
+        }
+        if (!opts.traceFile.empty()) {
+            timing::enableTrace();
+        }
+        if (!opts.memReportFile.empty()) {
+            memstats::enable();
+        }
+
+        memstats::Report memReport;
+        int rc = runPipeline(opts, diag, memReport);
+
+        if (opts.timeReport) {
+            timing::printReport(diag);
+        }
+        std::string err;
+        if (memstats::enabled() && !memstats::writeReport(opts.memReportFile, memReport, err)) {
+            diag << err << '\n';
+            rc = rc ? rc : 1;
+        }
+        if (!timing::writeTrace(opts.traceFile, err)) {
+            diag << err << '\n';
+            rc = rc ? rc : 1;
+        }
+
+        // the daemon compiles again in the same process
+        if (measuring) {
+            memstats::disable();
+        }
+        NamedValues.clear();
+        Errors.clear();
+        Builder.reset();
+        Module.reset();
+        return rc;
+    }
+} // cblt::driver
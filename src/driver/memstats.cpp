@@ -0,0 +1,204 @@
+#include "../h/memstats.h"
+#include "../h/alloc.h"
+#include "../h/timing.h"
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+
+using namespace cblt::ast;
+
+namespace cblt::memstats {
+    static std::atomic<bool> on{false};
+
+    void enable() {
+        on.store(true, std::memory_order_relaxed);
+        alloc::enableTracking();
+        timing::enableReport();
+    }
+
+    void disable() {
+        on.store(false, std::memory_order_relaxed);
+        alloc::disableTracking();
+        timing::disableReport();
+    }
+
+    bool enabled() {
+        return on.load(std::memory_order_relaxed);
+    }
+
+    static std::uint64_t heapBytes(const std::string &str) {
+        static const size_t inlineCapacity = std::string().capacity();
+        return str.capacity() > inlineCapacity ? str.capacity() + 1 : 0;
+    }
+
+    template<typename T>
+    static std::uint64_t vectorBytes(const std::vector<T> &vec) {
+        return vec.capacity() * sizeof(T);
+    }
+
+    static void add(std::map<std::string, NodeStats> &kinds, const char *kind, const std::uint64_t bytes) {
+        NodeStats &stats = kinds[kind];
+        stats.count++;
+        stats.bytes += bytes;
+    }
+
+    static void visit(const Node *node, std::map<std::string, NodeStats> &kinds);
+
+    template<typename T>
+    static void visitAll(const std::vector<std::unique_ptr<T>> &nodes, std::map<std::string, NodeStats> &kinds) {
+        for (const auto &node: nodes) {
+            visit(node.get(), kinds);
+        }
+    }
+
+    static void visit(const Node *node, std::map<std::string, NodeStats> &kinds) {
+        if (!node) {
+            return;
+        }
+
+        if (const auto *n = dynamic_cast<const Program *>(node)) {
+            add(kinds, "Program", sizeof(Program) + vectorBytes(n->stmts));
+            visitAll(n->stmts, kinds);
+        } else if (const auto *n = dynamic_cast<const VarDeclStmt *>(node)) {
+            add(kinds, "VarDeclStmt", sizeof(VarDeclStmt) + heapBytes(n->token.literal) + heapBytes(n->type));
+            visit(n->name.get(), kinds);
+            visit(n->value.get(), kinds);
+        } else if (const auto *n = dynamic_cast<const ReturnStmt *>(node)) {
+            add(kinds, "ReturnStmt", sizeof(ReturnStmt) + heapBytes(n->token.literal));
+            visit(n->returnValue.get(), kinds);
+        } else if (const auto *n = dynamic_cast<const ExprStmt *>(node)) {
+            add(kinds, "ExprStmt", sizeof(ExprStmt) + heapBytes(n->token.literal));
+            visit(n->expr.get(), kinds);
+        } else if (const auto *n = dynamic_cast<const BlockStmt *>(node)) {
+            add(kinds, "BlockStmt", sizeof(BlockStmt) + heapBytes(n->token.literal) + vectorBytes(n->stmts));
+            visitAll(n->stmts, kinds);
+        } else if (const auto *n = dynamic_cast<const WhileStmt *>(node)) {
+            add(kinds, "WhileStmt", sizeof(WhileStmt) + heapBytes(n->token.literal));
+            visit(n->condition.get(), kinds);
+            visit(n->body.get(), kinds);
+        } else if (const auto *n = dynamic_cast<const ExternStmt *>(node)) {
+            std::uint64_t bytes = sizeof(ExternStmt) + heapBytes(n->token.literal) + heapBytes(n->name) +
+                                  heapBytes(n->returnType) + vectorBytes(n->parameters) + vectorBytes(n->paramTypes);
+            for (const auto &type: n->paramTypes) {
+                bytes += heapBytes(type);
+            }
+            add(kinds, "ExternStmt", bytes);
+            visitAll(n->parameters, kinds);
+        } else if (const auto *n = dynamic_cast<const AssignStmt *>(node)) {
+            add(kinds, "AssignStmt", sizeof(AssignStmt) + heapBytes(n->token.literal));
+            visit(n->target.get(), kinds);
+            visit(n->value.get(), kinds);
+        } else if (const auto *n = dynamic_cast<const Identifier *>(node)) {
+            add(kinds, "Identifier", sizeof(Identifier) + heapBytes(n->token.literal) + heapBytes(n->value));
+        } else if (const auto *n = dynamic_cast<const NumLiteral *>(node)) {
+            add(kinds, "NumLiteral", sizeof(NumLiteral) + heapBytes(n->token.literal));
+        } else if (const auto *n = dynamic_cast<const Boolean *>(node)) {
+            add(kinds, "Boolean", sizeof(Boolean) + heapBytes(n->token.literal));
+        } else if (const auto *n = dynamic_cast<const StringLiteral *>(node)) {
+            add(kinds, "StringLiteral", sizeof(StringLiteral) + heapBytes(n->token.literal) + heapBytes(n->value));
+        } else if (const auto *n = dynamic_cast<const PrefixExpr *>(node)) {
+            add(kinds, "PrefixExpr", sizeof(PrefixExpr) + heapBytes(n->token.literal) + heapBytes(n->op));
+            visit(n->right.get(), kinds);
+        } else if (const auto *n = dynamic_cast<const InfixExpr *>(node)) {
+            add(kinds, "InfixExpr", sizeof(InfixExpr) + heapBytes(n->token.literal) + heapBytes(n->op));
+            visit(n->lhs.get(), kinds);
+            visit(n->rhs.get(), kinds);
+        } else if (const auto *n = dynamic_cast<const IfExpr *>(node)) {
+            add(kinds, "IfExpr", sizeof(IfExpr) + heapBytes(n->token.literal));
+            visit(n->condition.get(), kinds);
+            visit(n->consequence.get(), kinds);
+            visit(n->alternative.get(), kinds);
+        } else if (const auto *n = dynamic_cast<const FuncLiteral *>(node)) {
+            std::uint64_t bytes = sizeof(FuncLiteral) + heapBytes(n->token.literal) + heapBytes(n->name) +
+                                  heapBytes(n->returnType) + vectorBytes(n->parameters) + vectorBytes(n->paramTypes);
+            for (const auto &type: n->paramTypes) {
+                bytes += heapBytes(type);
+            }
+            add(kinds, "FuncLiteral", bytes);
+            visitAll(n->parameters, kinds);
+            visit(n->body.get(), kinds);
+        } else if (const auto *n = dynamic_cast<const CallExpr *>(node)) {
+            add(kinds, "CallExpr", sizeof(CallExpr) + heapBytes(n->token.literal) + vectorBytes(n->args));
+            visit(n->function.get(), kinds);
+            visitAll(n->args, kinds);
+        } else if (const auto *n = dynamic_cast<const ArrayLiteral *>(node)) {
+            add(kinds, "ArrayLiteral", sizeof(ArrayLiteral) + heapBytes(n->token.literal) + vectorBytes(n->elements));
+            visitAll(n->elements, kinds);
+        } else if (const auto *n = dynamic_cast<const IndexExpr *>(node)) {
+            add(kinds, "IndexExpr", sizeof(IndexExpr) + heapBytes(n->token.literal));
+            visit(n->left.get(), kinds);
+            visit(n->index.get(), kinds);
+        } else if (const auto *n = dynamic_cast<const HashLiteral *>(node)) {
+            add(kinds, "HashLiteral", sizeof(HashLiteral) + heapBytes(n->token.literal) + vectorBytes(n->pairs));
+            for (const auto &[key, value]: n->pairs) {
+                visit(key.get(), kinds);
+                visit(value.get(), kinds);
+            }
+        } else {
+            add(kinds, "Unknown", 0);
+        }
+    }
+
+    void countAst(const Node &node, std::map<std::string, NodeStats> &kinds) {
+        visit(&node, kinds);
+    }
+
+    bool writeReport(const std::string &path, Report &report, std::string &err) {
+        report.peakRssBytes = alloc::peakRssBytes();
+
+        std::ofstream out(path);
+        if (!out) {
+            err = "Mem report error: could not open " + path;
+            return false;
+        }
+
+        const double sourceMb = static_cast<double>(report.sourceBytes) / (1024.0 * 1024.0);
+        out << std::fixed << std::setprecision(3);
+        out << "{\n";
+        out << "  \"source_bytes\": " << report.sourceBytes << ",\n";
+        out << "  \"peak_rss_bytes\": " << report.peakRssBytes << ",\n";
+        out << "  \"peak_rss_per_source_mb\": "
+            << (sourceMb > 0 ? static_cast<double>(report.peakRssBytes) / sourceMb : 0.0) << ",\n";
+
+        out << "  \"phases\": {\n";
+        for (size_t i = 0; i < static_cast<size_t>(timing::Phase::COUNT); i++) {
+            const auto phase = static_cast<timing::Phase>(i);
+            const timing::PhaseStats stats = timing::getStats(phase);
+            out << "    \"" << timing::phaseToString(phase) << "\": {\"allocs\": " << stats.allocs
+                << ", \"bytes\": " << stats.allocBytes << "}"
+                << (i + 1 < static_cast<size_t>(timing::Phase::COUNT) ? ",\n" : "\n");
+        }
+        out << "  },\n";
+
+        out << "  \"tokens\": {\"count\": " << report.tokenCount
+            << ", \"bytes\": " << report.tokenBytes
+            << ", \"avg_bytes\": "
+            << (report.tokenCount ? static_cast<double>(report.tokenBytes) / static_cast<double>(report.tokenCount) : 0.0)
+            << "},\n";
+
+        NodeStats total;
+        for (const auto &[kind, stats]: report.astKinds) {
+            total.count += stats.count;
+            total.bytes += stats.bytes;
+        }
+        out << "  \"ast\": {\n";
+        out << "    \"count\": " << total.count << ",\n";
+        out << "    \"bytes\": " << total.bytes << ",\n";
+        out << "    \"kinds\": {";
+        bool first = true;
+        for (const auto &[kind, stats]: report.astKinds) {
+            out << (first ? "\n" : ",\n");
+            out << "      \"" << kind << "\": {\"count\": " << stats.count << ", \"bytes\": " << stats.bytes << "}";
+            first = false;
+        }
+        out << "\n    }\n";
+        out << "  }\n";
+        out << "}\n";
+
+        if (!out) {
+            err = "Mem report error: failed writing " + path;
+            return false;
+        }
+        return true;
+    }
+} // cblt::memstats
@@ -0,0 +1,71 @@
+// shared by the daemon and CobaltClient, which doesn't link llvm
+#include "../h/daemon.h"
+#include <cerrno>
+#include <cstdlib>
+#include <unistd.h>
+
+namespace cblt::daemon {
+    // strings are capped so a bad peer can't make the other side allocate gigabytes
+    static constexpr std::uint32_t MAX_STRING = 64 << 20;
+
+    std::string defaultSocketPath() {
+        if (const char *env = std::getenv("CBLT_DAEMON_SOCKET"); env && *env) {
+            return env;
+        }
+        return "/tmp/cobalt-" + std::to_string(getuid()) + ".sock";
+    }
+
+    bool writeAll(const int fd, const void *data, std::size_t size) {
+        const auto *p = static_cast<const char *>(data);
+        while (size) {
+            const ssize_t n = write(fd, p, size);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            p += n;
+            size -= static_cast<std::size_t>(n);
+        }
+        return true;
+    }
+
+    bool readAll(const int fd, void *data, std::size_t size) {
+        auto *p = static_cast<char *>(data);
+        while (size) {
+            const ssize_t n = read(fd, p, size);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            p += n;
+            size -= static_cast<std::size_t>(n);
+        }
+        return true;
+    }
+
+    bool writeU32(const int fd, const std::uint32_t value) {
+        return writeAll(fd, &value, sizeof(value));
+    }
+
+    bool readU32(const int fd, std::uint32_t &value) {
+        return readAll(fd, &value, sizeof(value));
+    }
+
+    bool writeString(const int fd, const std::string &str) {
+        return str.size() <= MAX_STRING && writeU32(fd, static_cast<std::uint32_t>(str.size())) &&
+               writeAll(fd, str.data(), str.size());
+    }
+
+    bool readString(const int fd, std::string &str) {
+        std::uint32_t size;
+        if (!readU32(fd, size) || size > MAX_STRING) {
+            return false;
+        }
+        str.resize(size);
+        return readAll(fd, str.data(), size);
+    }
+} // cblt::daemon
@@ -0,0 +1,189 @@
+#include "../h/timing.h"
+#include "../h/alloc.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/TimeProfiler.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <iomanip>
+#include <mutex>
+
+namespace cblt::timing {
+    // read by every compile on a daemon, set by the measuring one
+    static std::atomic<bool> reportOn{false};
+    static std::atomic<bool> traceOn{false};
+    static std::mutex statsMutex;
+    static std::array<PhaseStats, static_cast<size_t>(Phase::COUNT)> stats;
+    static thread_local PhaseScope *current = nullptr;
+
+    std::string phaseToString(const Phase phase) {
+        switch (phase) {
+            case Phase::READ: return "read";
+            case Phase::LEX: return "lex";
+            case Phase::PARSE: return "parse";
+            case Phase::SEMA: return "sema";
+            case Phase::IRGEN: return "irgen";
+            case Phase::OPT: return "opt";
+            case Phase::EMIT: return "emit";
+            default: return "unknown";
+        }
+    }
+
+    static double wallNowMs() {
+        using namespace std::chrono;
+        return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    // per thread so parallel phases don't bill each other
+    static double cpuNowMs() {
+        timespec ts{};
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+        return static_cast<double>(ts.tv_sec) * 1e3 + static_cast<double>(ts.tv_nsec) / 1e6;
+    }
+
+    void enableReport() {
+        reportOn.store(true, std::memory_order_relaxed);
+    }
+
+    void disableReport() {
+        std::lock_guard lock(statsMutex);
+        reportOn.store(false, std::memory_order_relaxed);
+        stats = {};
+    }
+
+    bool reportEnabled() {
+        return reportOn.load(std::memory_order_relaxed);
+    }
+
+    PhaseStats getStats(const Phase phase) {
+        std::lock_guard lock(statsMutex);
+        return stats[static_cast<size_t>(phase)];
+    }
+
+    void printReport(std::ostream &os) {
+        std::lock_guard lock(statsMutex);
+        PhaseStats total;
+        os << "===== Cobalt time report =====\n";
+        os << std::left << std::setw(8) << "phase"
+           << std::right << std::setw(12) << "wall(ms)"
+           << std::setw(12) << "cpu(ms)"
+           << std::setw(12) << "allocs"
+           << std::setw(14) << "bytes" << '\n';
+        os << std::fixed << std::setprecision(3);
+        for (size_t i = 0; i < stats.size(); i++) {
+            const PhaseStats &s = stats[i];
+            os << std::left << std::setw(8) << phaseToString(static_cast<Phase>(i))
+               << std::right << std::setw(12) << s.wallMs
+               << std::setw(12) << s.cpuMs
+               << std::setw(12) << s.allocs
+               << std::setw(14) << s.allocBytes << '\n';
+            total.wallMs += s.wallMs;
+            total.cpuMs += s.cpuMs;
+            total.allocs += s.allocs;
+            total.allocBytes += s.allocBytes;
+        }
+        os << std::left << std::setw(8) << "total"
+           << std::right << std::setw(12) << total.wallMs
+           << std::setw(12) << total.cpuMs
+           << std::setw(12) << total.allocs
+           << std::setw(14) << total.allocBytes << '\n';
+        os.unsetf(std::ios::floatfield);
+    }
+
+    void enableTrace() {
+        if (traceOn.load(std::memory_order_relaxed)) {
+            return;
+        }
+        // granularity 0 keeps every span, codegen spans per fnc are short
+        llvm::timeTraceProfilerInitialize(0, "Cobalt");
+        traceOn.store(true, std::memory_order_relaxed);
+    }
+
+    bool traceEnabled() {
+        return traceOn.load(std::memory_order_relaxed);
+    }
+
+    bool writeTrace(const std::string &path, std::string &err) {
+        if (!traceOn.load(std::memory_order_relaxed)) {
+            return true;
+        }
+        if (llvm::Error e = llvm::timeTraceProfilerWrite(path, "cobalt")) {
+            err = "Trace error: " + llvm::toString(std::move(e));
+            return false;
+        }
+        llvm::timeTraceProfilerCleanup();
+        traceOn.store(false, std::memory_order_relaxed);
+        return true;
+    }
+
+    // ---------- PhaseScope Implementations ---------
+    PhaseScope::PhaseScope(const Phase phase, const bool traced)
+        : phase(phase), active(reportOn.load(std::memory_order_relaxed)),
+          traced(traced && llvm::timeTraceProfilerEnabled()),
+          parent(nullptr), wallStart(0), cpuStart(0), allocStart(0), bytesStart(0) {
+        if (this->traced) {
+            llvm::timeTraceProfilerBegin(phaseToString(phase), "");
+        }
+        if (!active) {
+            return;
+        }
+        parent = current;
+        if (parent) {
+            parent->pause();
+        }
+        current = this;
+        resume();
+    }
+
+    PhaseScope::~PhaseScope() {
+        if (active) {
+            pause();
+            acc.entries = 1;
+            {
+                std::lock_guard lock(statsMutex);
+                PhaseStats &s = stats[static_cast<size_t>(phase)];
+                s.wallMs += acc.wallMs;
+                s.cpuMs += acc.cpuMs;
+                s.allocs += acc.allocs;
+                s.allocBytes += acc.allocBytes;
+                s.entries += acc.entries;
+            }
+            current = parent;
+            if (parent) {
+                parent->resume();
+            }
+        }
+        if (traced) {
+            llvm::timeTraceProfilerEnd();
+        }
+    }
+
+    void PhaseScope::pause() {
+        acc.wallMs += wallNowMs() - wallStart;
+        acc.cpuMs += cpuNowMs() - cpuStart;
+        acc.allocs += alloc::threadAllocCount() - allocStart;
+        acc.allocBytes += alloc::threadAllocBytes() - bytesStart;
+    }
+
+    void PhaseScope::resume() {
+        wallStart = wallNowMs();
+        cpuStart = cpuNowMs();
+        allocStart = alloc::threadAllocCount();
+        bytesStart = alloc::threadAllocBytes();
+    }
+
+    // ---------- ThreadScope Implementations ---------
+    ThreadScope::ThreadScope(const std::string &name) : active(traceOn.load(std::memory_order_relaxed)) {
+        alloc::joinTracking();
+        if (active) {
+            llvm::timeTraceProfilerInitialize(0, name);
+        }
+    }
+
+    ThreadScope::~ThreadScope() {
+        if (active) {
+            llvm::timeTraceProfilerFinishThread();
+        }
+    }
+} // cblt::timing
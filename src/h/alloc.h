@@ -0,0 +1,25 @@
+#pragma once
+
+#ifndef ALLOC_H
+#define ALLOC_H
+
+#include <cstdint>
+
+namespace cblt::alloc {
+    // counting is opt in, the replacement operator new in driver/alloc_hook.cpp
+    // only touches the counters once tracking is on, and only on the thread
+    // that turned it on or joined. a thread the compile starts joins itself
+    void enableTracking();
+    void joinTracking();
+    void disableTracking();
+    [[nodiscard]] bool trackingEnabled();
+
+    // operator new calls and requested bytes made by the calling thread so far
+    [[nodiscard]] std::uint64_t threadAllocCount();
+    [[nodiscard]] std::uint64_t threadAllocBytes();
+
+    // high water mark of the process resident set, in bytes
+    [[nodiscard]] std::uint64_t peakRssBytes();
+}
+
+#endif //ALLOC_H
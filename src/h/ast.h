@@ -3,7 +3,11 @@
 #ifndef AST_H
 #define AST_H
 
+#include <functional>
+#include <memory>
+#include <set>
 #include <string>
+#include <utility>
 #include <vector>
 #include "../h/cobalt.h"
 #include "../h/lexer.h"
@@ -19,6 +23,7 @@ namespace cblt::ast {
 
     struct Stmt : Node {
         virtual void stmtNode() = 0;
+        [[nodiscard]] virtual int TokenLine() const = 0; // source line for debug info
     };
 
     struct Expr : Node {
@@ -33,6 +38,7 @@ namespace cblt::ast {
         explicit Identifier(lex::Token token, std::string value);
         [[nodiscard]] std::string TokenLiteral() const override;
         [[nodiscard]] std::string String() const override;
+        llvm::Value *codegen() override;
     };
 
     struct Program final : Node {
@@ -46,10 +52,12 @@ namespace cblt::ast {
     struct VarDeclStmt final : Stmt {
         lex::Token token;
         std::unique_ptr<Identifier> name;
+        std::string type; // num, bool, str, []num ...
         std::unique_ptr<Expr> value;
 
         void stmtNode() override {}
         [[nodiscard]] std::string TokenLiteral() const override;
+        [[nodiscard]] int TokenLine() const override;
         [[nodiscard]] std::string String() const override;
         llvm::Value *codegen() override;
     };
@@ -60,6 +68,7 @@ namespace cblt::ast {
 
         void stmtNode() override {}
         [[nodiscard]] std::string TokenLiteral() const override;
+        [[nodiscard]] int TokenLine() const override;
         [[nodiscard]] std::string String() const override;
         llvm::Value *codegen() override;
     };
@@ -70,6 +79,7 @@ namespace cblt::ast {
 
         void stmtNode() override {}
         [[nodiscard]] std::string TokenLiteral() const override;
+        [[nodiscard]] int TokenLine() const override;
         [[nodiscard]] std::string String() const override;
         llvm::Value *codegen() override;
     };
@@ -80,6 +90,49 @@ namespace cblt::ast {
 
         void stmtNode() override {}
         [[nodiscard]] std::string TokenLiteral() const override;
+        [[nodiscard]] int TokenLine() const override;
+        [[nodiscard]] std::string String() const override;
+        llvm::Value *codegen() override;
+    };
+
+    struct WhileStmt final : Stmt {
+        lex::Token token; // must be while
+        std::unique_ptr<Expr> condition;
+        std::unique_ptr<BlockStmt> body;
+
+        void stmtNode() override {}
+        [[nodiscard]] std::string TokenLiteral() const override;
+        [[nodiscard]] int TokenLine() const override;
+        [[nodiscard]] std::string String() const override;
+        llvm::Value *codegen() override;
+    };
+
+    // target is an Identifier or an IndexExpr into an array
+    struct AssignStmt final : Stmt {
+        lex::Token token; // the =
+        std::unique_ptr<Expr> target;
+        std::unique_ptr<Expr> value;
+
+        void stmtNode() override {}
+        [[nodiscard]] std::string TokenLiteral() const override;
+        [[nodiscard]] int TokenLine() const override;
+        [[nodiscard]] std::string String() const override;
+        llvm::Value *codegen() override;
+    };
+
+    // extern [pure] fnc name(a: num, xs: []num) -> num; a c function the
+    // program is linked against. no return type means it returns nothing
+    struct ExternStmt final : Stmt {
+        lex::Token token; // must be extern
+        std::string name;
+        std::vector<std::unique_ptr<Identifier>> parameters;
+        std::vector<std::string> paramTypes;
+        std::string returnType;
+        bool pure = false; // depends only on its args and has no side effects
+
+        void stmtNode() override {}
+        [[nodiscard]] std::string TokenLiteral() const override;
+        [[nodiscard]] int TokenLine() const override;
         [[nodiscard]] std::string String() const override;
         llvm::Value *codegen() override;
     };
@@ -100,6 +153,7 @@ namespace cblt::ast {
         bool value;
 
         explicit Boolean(bool value);
+        Boolean(lex::Token token, bool value);
         void exprNode() override {}
         [[nodiscard]] std::string TokenLiteral() const override;
         [[nodiscard]] std::string String() const override;
@@ -108,7 +162,7 @@ namespace cblt::ast {
 
     struct PrefixExpr final : Expr {
         lex::Token token;
-        std::string op;
+        std::string op; // -, !, await or spawn
         std::unique_ptr<Expr> right;
 
         void exprNode() override {}
@@ -122,6 +176,7 @@ namespace cblt::ast {
         std::unique_ptr<Expr> lhs;
         std::unique_ptr<Expr> rhs;
         std::string op;
+        bool escapes = true; // for str +, cleared by sema::analyzeEscapes to build the result in the fnc's region
 
         void exprNode() override {}
         [[nodiscard]] std::string TokenLiteral() const override;
@@ -143,12 +198,19 @@ namespace cblt::ast {
 
     struct FuncLiteral final : Expr {
         lex::Token token;
+        std::string name; // empty for anonymous fnc literals
         std::vector<std::unique_ptr<Identifier>> parameters;
+        std::vector<std::string> paramTypes;
+        std::string returnType;
         std::unique_ptr<BlockStmt> body;
+        bool topLevel = false; // named fnc at program level, a plain function without an environment
+        bool escapes = true; // cleared by sema::analyzeEscapes when the closure can't outlive its creator
+        bool async = false; // async fnc, a coroutine that runs as a task, see runtime/tasks.cpp
 
         void  exprNode() override {}
         [[nodiscard]] std::string TokenLiteral() const override;
         [[nodiscard]] std::string String() const override;
+        llvm::Function *declare(); // prototype only, lets calls precede the definition
         llvm::Value *codegen() override;
     };
 
@@ -156,6 +218,7 @@ namespace cblt::ast {
         lex::Token token;
         std::unique_ptr<Expr> function;
         std::vector<std::unique_ptr<Expr>> args;
+        bool tail = false; // operand of a return, lowered as a guaranteed tail call
 
         void exprNode() override {}
         [[nodiscard]] std::string TokenLiteral() const override;
@@ -180,6 +243,7 @@ namespace cblt::ast {
     struct ArrayLiteral final : Expr {
         lex::Token token;
         std::vector<std::unique_ptr<Expr>> elements;
+        bool escapes = true; // cleared by sema::analyzeEscapes when the data can live in the fnc's region
 
         void exprNode() override {}
         [[nodiscard]] std::string TokenLiteral() const override;
@@ -200,18 +264,31 @@ namespace cblt::ast {
     };
 
 
-    // This must also be looked at, not very easy to implement
-    /*
+    // {key: value, ...}, pairs stay in source order so later duplicates win
     struct HashLiteral final : Expr {
         lex::Token token;
-        std::unordered_map<Expr, Expr> pairs;
+        std::vector<std::pair<std::unique_ptr<Expr>, std::unique_ptr<Expr>>> pairs;
 
         void exprNode() override {}
         [[nodiscard]] std::string TokenLiteral() const override;
         [[nodiscard]] std::string String() const override;
         llvm::Value *codegen() override;
     };
-    */
+
+    // calls fn on each direct child of node, in source order
+    void forEachChild(Node *node, const std::function<void(Node *)> &fn);
+
+    // names assigned with name = somewhere under node, not counting nested
+    // fncs, which collect their own. codegen keeps these in allocas
+    void collectAssigned(Node *node, std::set<std::string> &names);
+
+    // Program::codegen in steps, for streaming compiles that lower each
+    // program level statement as it's parsed and free it straight after.
+    // beginMain declares the top level fncs, only their signatures are read,
+    // and opens main. assigned is collectAssigned over every statement
+    void beginMain(const std::vector<FuncLiteral *> &fncs, std::set<std::string> assigned, int firstLine);
+    void lowerTopLevel(Stmt &stmt);
+    llvm::Function *finishMain();
 }
 
 #endif //AST_H
@@ -15,12 +15,17 @@
 #include "llvm/IR/Type.h"
 #include "llvm/IR/Verifier.h"
 #include <map>
+#include <string>
+#include <vector>
 
 namespace cblt::globals {
-    static llvm::LLVMContext Context; // llvm core
-    static std::unique_ptr<llvm::IRBuilder<>> Builder; // ir generation assist
-    static std::unique_ptr<llvm::Module> Module; // functions and global variables
-    static std::map<std::string, llvm::Value *> NamedValues; // values in scope track
+    // inline so every translation unit shares one codegen state, thread_local
+    // so each compile the daemon runs on its own thread gets its own
+    inline thread_local llvm::LLVMContext Context; // llvm core
+    inline thread_local std::unique_ptr<llvm::IRBuilder<>> Builder; // ir generation assist
+    inline thread_local std::unique_ptr<llvm::Module> Module; // functions and global variables
+    inline thread_local std::map<std::string, llvm::Value *> NamedValues; // values in scope track
+    inline thread_local std::vector<std::string> Errors; // codegen errors, same format as lexer/parser ones
 }
 
 #endif //COBALT_H
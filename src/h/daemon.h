@@ -0,0 +1,34 @@
+#pragma once
+
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace cblt::daemon {
+    // Cobalt --daemon[=socket] keeps llvm and the target set up and serves
+    // compiles over a unix socket, each request on its own thread with its
+    // own codegen state. finished outputs are remembered, so an unchanged
+    // file is answered without running llvm. CobaltClient takes the
+    // compiler's command line and forwards it. both sides default to
+    // $CBLT_DAEMON_SOCKET, else /tmp/cobalt-<uid>.sock
+    [[nodiscard]] std::string defaultSocketPath();
+
+    // wire format, both ends are on the same machine so integers are host order
+    //   request:  cwd, argc, argc args (without argv[0])
+    //   response: exit code, diagnostics, the output when it was -o -
+    // strings are a u32 length followed by the bytes
+    bool writeAll(int fd, const void *data, std::size_t size);
+    bool readAll(int fd, void *data, std::size_t size);
+    bool writeU32(int fd, std::uint32_t value);
+    bool readU32(int fd, std::uint32_t &value);
+    bool writeString(int fd, const std::string &str);
+    bool readString(int fd, std::string &str);
+
+    // blocks serving requests, returns only on a setup error
+    int serve(const std::string &socketPath);
+}
+
+#endif //DAEMON_H
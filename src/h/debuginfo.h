@@ -0,0 +1,29 @@
+#pragma once
+
+#ifndef DEBUGINFO_H
+#define DEBUGINFO_H
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
+#include <string>
+
+namespace cblt::debug {
+    // line tables only, enough for perf report / annotate, addr2line and
+    // debugger stepping to map generated code back to cobalt source lines.
+    // -g0 turns it off
+    void setEnabled(bool on);
+    [[nodiscard]] bool enabled();
+
+    // opens the compile unit for the file being compiled
+    void beginModule(llvm::Module &module, const std::string &path, bool optimized);
+
+    // codegen hooks. every fnc gets a subprogram at the line of its literal,
+    // statements set the builder's location as they are generated
+    void enterFunction(llvm::Function *fn, int line);
+    void leaveFunction();
+    void setLine(int line);
+
+    void finishModule(llvm::Module &module);
+}
+
+#endif //DEBUGINFO_H
@@ -0,0 +1,72 @@
+#pragma once
+
+#ifndef DOCUMENT_H
+#define DOCUMENT_H
+
+#include "../h/ast.h"
+#include "../h/lexer.h"
+#include "../h/parser.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace cblt::parse {
+    // a file open in an editor, kept lexed and parsed across edits. an edit
+    // re-lexes from the token before it until the new tokens line up with
+    // the old ones again, the rest are kept with their offsets and lines
+    // shifted. only the program level statements that read a replaced token
+    // are parsed again, the others stay in the Program as they were
+    class Document {
+        // one parseStmt call at program level, a lone ; included. it reads the
+        // tokens [begin, end], end being the one token of lookahead
+        struct Unit {
+            std::uint32_t begin, end;
+            bool hasStmt;
+            int staleLines; // line shift not yet applied to the stmt's tokens
+            std::vector<std::string> errors;
+        };
+
+        struct LexError {
+            std::uint32_t start; // of the token that reported it
+            std::string message;
+        };
+
+        lex::Lexer lexer;
+        lex::TokenBuffer tokens;
+        Parser parser;
+        ast::Program prog;
+        std::vector<Unit> units;
+        std::vector<LexError> lexErrors;
+
+        // lexes from offset on line, adding tokens to buf until one starts at
+        // an old token's start plus delta. returns that old token's index,
+        // or the old EoF's when nothing lined up
+        std::size_t relex(std::size_t offset, int line, std::size_t syncFrom, std::ptrdiff_t delta,
+                          lex::TokenBuffer &buf, std::vector<LexError> &errs);
+        // parses units from token index begin, stopping at the first boundary
+        // that is the begin of an old unit from syncFrom on, shifted by delta
+        std::size_t reparse(std::size_t begin, std::size_t syncFrom, std::ptrdiff_t delta,
+                            std::vector<Unit> &fresh, std::vector<std::unique_ptr<ast::Stmt>> &stmts);
+
+    public:
+        explicit Document(std::string text);
+        // the parser keeps a reference to tokens
+        Document(const Document &) = delete;
+        Document &operator=(const Document &) = delete;
+
+        // replaces removed bytes at offset with inserted, false when the range
+        // is outside the text
+        bool edit(std::size_t offset, std::size_t removed, std::string_view inserted);
+
+        [[nodiscard]] std::string_view text() const;
+        // lex errors then parse errors, the same list a full parse gives
+        [[nodiscard]] std::vector<std::string> diagnostics() const;
+        // the statements with their line numbers brought up to date
+        ast::Program &program();
+        [[nodiscard]] const lex::TokenBuffer &tokenBuffer() const;
+    };
+} // cblt::parse
+
+#endif //DOCUMENT_H
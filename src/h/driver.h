@@ -0,0 +1,36 @@
+#pragma once
+
+#ifndef DRIVER_H
+#define DRIVER_H
+
+#include <ostream>
+#include <string>
+
+namespace cblt::driver {
+    struct Options {
+        std::string input;
+        std::string output; // defaults to input with .o or .ll
+        bool emitLLVM = false; // --emit-llvm
+        int optLevel = 2; // -O0 .. -O3
+        bool timeReport = false; // --time-report
+        std::string traceFile; // --trace=out.json
+        std::string memReportFile; // --mem-report=out.json
+        std::string profileGenerate; // -fprofile-generate[=default.cblprof]
+        std::string profileUse; // -fprofile-use=path
+        std::string profile; // --profile[=cobalt.profile], fnc timings written by the program at exit
+        bool warnNonTailRecursion = false; // -Wnon-tail-recursion
+        bool debugInfo = true; // line tables for perf and debuggers, -g0 strips them
+        bool stream = false; // --stream, codegen each statement on its own thread as it's parsed
+    };
+
+    // returns false and fills err on a bad command line
+    bool parseArgs(int argc, char **argv, Options &opts, std::string &err);
+
+    [[nodiscard]] const char *usage();
+
+    // read, lex, parse, generate, optimize and emit one file, returns the exit
+    // code. diagnostics and reports go to diag
+    int compile(const Options &opts, std::ostream &diag);
+}
+
+#endif //DRIVER_H
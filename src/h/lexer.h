@@ -3,11 +3,15 @@
 #ifndef LEXER_H
 #define LEXER_H
 
+#include <cstdint>
 #include <vector>
 #include <iostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 
 namespace cblt::lex {
-    enum struct TokenType {
+    enum struct TokenType : std::uint8_t {
         IDENT,
         NUM,
         STRING,
@@ -63,6 +67,10 @@ namespace cblt::lex {
         CONTINUE,
         TRUE,
         FALSE,
+        ASYNC,
+        AWAIT,
+        SPAWN,
+        EXTERN,
 
         NEWLINE,
         ILLEGAL,
@@ -84,12 +92,52 @@ namespace cblt::lex {
         [[nodiscard]] std::string toString() const;
     };
 
+    // a whole file tokenized up front, one array per field. the parser walks
+    // kinds and lines and only builds a Token for the nodes that keep one.
+    // text views the lexer's input, so the lexer has to outlive the buffer.
+    // indexes count from the start of the file even once a prefix is dropped
+    struct TokenBuffer {
+        std::string_view source;
+        std::size_t first = 0; // index of kinds[0], the tokens before it were dropped
+        std::vector<TokenType> kinds;
+        std::vector<std::uint32_t> offsets;
+        std::vector<std::uint32_t> lengths;
+        std::vector<int> lines;
+        // NUM values decoded while lexing, keyed by token index in ascending order
+        std::vector<std::uint32_t> numTokens;
+        std::vector<double> numValues;
+
+        // one past the last index, dropped tokens included
+        [[nodiscard]] std::size_t size() const;
+        [[nodiscard]] std::string_view text(std::size_t i) const;
+        // where the lexer started the token, before the opening quote of a str
+        [[nodiscard]] std::uint32_t start(std::size_t i) const;
+        [[nodiscard]] double number(std::size_t i) const;
+        [[nodiscard]] Token token(std::size_t i) const;
+        // heap the arrays hold, for --mem-report
+        [[nodiscard]] std::size_t bytes() const;
+        // frees the tokens before index, which can't be read afterwards
+        void dropBefore(std::size_t index);
+    };
+
     class Lexer {
+        // a token without its text, which is input[offset, offset + length)
+        struct Lexeme {
+            TokenType type;
+            std::uint32_t offset, length;
+            int line;
+        };
+
         std::string input;
         char ch;
-        int pos, readPos, line;
+        std::size_t pos, readPos;
+        int line;
         std::vector<std::string> errors;
-        std::unordered_map<std::string, TokenType> keywords;
+        std::unordered_map<std::string_view, TokenType> keywords;
+        size_t tokenCount = 0, tokenBytes = 0; // memory accounting, see driver/memstats.cpp
+
+        Lexeme scan();
+        TokenType oneOrTwo(char second, TokenType two, TokenType one);
 
     public:
         explicit Lexer(std::string input);
@@ -100,15 +148,37 @@ namespace cblt::lex {
 
         [[nodiscard]] Token nextToken();
 
+        // lexes everything left and decodes the num literals with from_chars
+        [[nodiscard]] TokenBuffer tokenize();
+        // lexes one token onto the end of buf, the step tokenize repeats
+        void lexInto(TokenBuffer &buf);
+
+        // for re-lexing after an edit, see parse::Document. replace edits the
+        // input in place, seek moves to a token start on the given line
+        void replace(std::size_t offset, std::size_t removed, std::string_view inserted);
+        void seek(std::size_t offset, int line);
+        [[nodiscard]] std::string_view getInput() const;
+        // hands over the errors so far, leaving none behind
+        [[nodiscard]] std::vector<std::string> takeErrors();
+
         [[nodiscard]] char peekChar() const;
 
         static Token newToken(TokenType tt, const std::string &lit, int lineNum);
 
-        std::string readIdent();
+        std::string_view readIdent();
+
+        // false when the literal has more than one decimal point
+        bool readNumber();
+
+        std::string_view readString();
 
-        std::vector<std::string> readNumber();
+        [[nodiscard]] std::vector<std::string> getErrors() const;
 
-        std::string readString();
+        [[nodiscard]] size_t getInputSize() const;
+        // tokens handed out so far and the bytes they own, Token itself plus any
+        // heap literal, or the arrays of the buffer from tokenize()
+        [[nodiscard]] size_t getTokenCount() const;
+        [[nodiscard]] size_t getTokenBytes() const;
     };
 }
 #endif //LEXER_H
@@ -0,0 +1,38 @@
+#pragma once
+
+#ifndef MEMSTATS_H
+#define MEMSTATS_H
+
+#include "../h/ast.h"
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace cblt::memstats {
+    struct NodeStats {
+        std::uint64_t count = 0;
+        std::uint64_t bytes = 0; // node object plus the strings and vectors it owns
+    };
+
+    struct Report {
+        std::uint64_t sourceBytes = 0;
+        std::uint64_t tokenCount = 0;
+        std::uint64_t tokenBytes = 0;
+        std::map<std::string, NodeStats> astKinds;
+        std::uint64_t peakRssBytes = 0;
+    };
+
+    // --mem-report=out.json, turns on allocation tracking and phase stats
+    void enable();
+    // also stops the tracking and phase stats enable() started
+    void disable();
+    [[nodiscard]] bool enabled();
+
+    // tallies every node reachable from node by kind, adding to what kinds holds
+    void countAst(const ast::Node &node, std::map<std::string, NodeStats> &kinds);
+
+    // phase stats come from timing, rss is sampled when the report is written
+    bool writeReport(const std::string &path, Report &report, std::string &err);
+}
+
+#endif //MEMSTATS_H
@@ -5,6 +5,9 @@
 
 #include "../h/lexer.h"
 #include "../h/ast.h"
+#include <functional>
+#include <memory>
+#include <set>
 #include <unordered_map>
 #include <vector>
 
@@ -16,6 +19,8 @@ namespace cblt::parse {
     enum class Precedence {
         NONE = 0,
         LOWEST,
+        LOGICAL_OR,
+        LOGICAL_AND,
         EQUALS,
         LESSGREATER,
         SUM,
@@ -26,28 +31,39 @@ namespace cblt::parse {
     };
 
     inline std::unordered_map<lex::TokenType, Precedence> precedences = {
+        {lex::TokenType::OR, Precedence::LOGICAL_OR},
+        {lex::TokenType::AND, Precedence::LOGICAL_AND},
         {lex::TokenType::EQ, Precedence::EQUALS},
         {lex::TokenType::NEQ, Precedence::EQUALS},
         {lex::TokenType::LT, Precedence::LESSGREATER},
         {lex::TokenType::GT, Precedence::LESSGREATER},
+        {lex::TokenType::LTE, Precedence::LESSGREATER},
+        {lex::TokenType::GTE, Precedence::LESSGREATER},
         {lex::TokenType::PLUS, Precedence::SUM},
         {lex::TokenType::MINUS, Precedence::SUM},
         {lex::TokenType::SLASH, Precedence::PRODUCT},
         {lex::TokenType::ASTERISK, Precedence::PRODUCT},
+        {lex::TokenType::PERCENT, Precedence::PRODUCT},
         {lex::TokenType::LPAREN, Precedence::CALL},
         {lex::TokenType::LBRACKET, Precedence::INDEX},
     };
 
     class Parser {
-        lex::Lexer &lexer;
+        // the whole file is lexed up front, cur indexes the token being parsed.
+        // tokens is owned unless the buffer was lent, as a Document does
+        lex::TokenBuffer owned;
+        const lex::TokenBuffer &tokens;
+        std::size_t cur = 0;
         std::vector<std::string> errors;
-        lex::Token curToken;
-        lex::Token peekToken;
         std::unordered_map<lex::TokenType, PrefixParseFn> prefixParseFns;
         std::unordered_map<lex::TokenType, InfixParseFn> infixParseFns;
 
+        void registerParseFns();
+
     public:
         explicit Parser(lex::Lexer &lexer);
+        // parses a buffer someone else keeps, which has to outlive the parser
+        explicit Parser(const lex::TokenBuffer &buffer);
         void registerPrefix(lex::TokenType tt, PrefixParseFn func);
         void registerInfix(lex::TokenType tt, InfixParseFn func);
         void nextToken();
@@ -58,33 +74,72 @@ namespace cblt::parse {
         int peekPrecedence();
         int currentPrecedence();
 
+        // tokens past the end read as the final EoF
+        [[nodiscard]] lex::TokenType kindAt(std::size_t i) const;
+        [[nodiscard]] int lineAt(std::size_t i) const;
+        // a Token for the ast node being built, the only place a literal is copied
+        [[nodiscard]] lex::Token curToken() const;
+        [[nodiscard]] std::string curLiteral() const;
+
         [[nodiscard]] bool curTokenIs(lex::TokenType tt) const;
-        [[nodiscard]] bool peekTokenIs(lex::TokenType tt) const;
-        [[nodiscard]] bool expectPeek(lex::TokenType tt) const;
+        // ahead tokens past cur, lookahead is an index so any distance is free
+        [[nodiscard]] bool peekTokenIs(lex::TokenType tt, std::size_t ahead = 1) const;
+        [[nodiscard]] bool expectPeek(lex::TokenType tt);
         [[nodiscard]] std::vector<std::string> getErrors() const;
 
-        ast::Program *parseProgram();
-        ast::Stmt *parseStmt();
-        ast::VarDeclStmt *parseVarDeclStmt();
-        ast::ReturnStmt *parseReturnStmt();
-        ast::Expr *parseExpr(int precedence);
-        ast::ExprStmt *parseExprStmt();
-        ast::Identifier *parseIdentifier();
-
-        ast::Expr *parseNumLiteral();
-        ast::Expr *parseStringLiteral();
-        ast::Expr *parsePrefixExpr();
-        ast::Expr *parseInfixExpr();
-        ast::Expr *parseBoolean();
-        ast::Expr *parseGroupedExpr();
-        ast::Expr *parseIfExpr();
-        ast::BlockStmt *parseBlockStmt();
-        ast::Expr *parseFuncLiteral();
-        std::vector<ast::Identifier> *parseFunctionParams();
-        ast::Expr *parseFunctionCall(ast::CallExpr function);
-
-
+        std::unique_ptr<ast::Program> parseProgram();
+        // the next program level statement, null once the input is used up.
+        // a streaming compile pulls these one at a time instead of a Program
+        std::unique_ptr<ast::Stmt> parseNext();
+        // what a streaming compile needs before the first statement, from one
+        // pass over the tokens: the signatures of the named fncs that start a
+        // program level statement, bodies left out, and every name assigned
+        // with name = anywhere, fnc bodies included. leaves the parser at the
+        // first token with no errors
+        struct Outline {
+            std::vector<std::unique_ptr<ast::FuncLiteral>> fncs;
+            std::set<std::string> assigned;
+        };
+        Outline outline();
+        // frees the tokens already parsed when the parser owns them, a
+        // streaming compile calls it between statements. they can't be
+        // seeked back to afterwards
+        void dropParsed();
+        // the token index parsing is at, and moving it, to reparse from a
+        // statement boundary. takeErrors hands over the errors so far
+        [[nodiscard]] std::size_t position() const;
+        void seek(std::size_t index);
+        [[nodiscard]] std::vector<std::string> takeErrors();
+        std::unique_ptr<ast::Stmt> parseStmt();
+        std::unique_ptr<ast::VarDeclStmt> parseVarDeclStmt();
+        std::unique_ptr<ast::ReturnStmt> parseReturnStmt();
+        std::unique_ptr<ast::WhileStmt> parseWhileStmt();
+        std::unique_ptr<ast::ExternStmt> parseExternStmt();
+        std::unique_ptr<ast::Expr> parseExpr(int precedence);
+        std::unique_ptr<ast::Stmt> parseExprStmt();
+        std::unique_ptr<ast::Identifier> parseIdentifier();
+        std::string parseType();
+
+        std::unique_ptr<ast::Expr> parseNumLiteral();
+        std::unique_ptr<ast::Expr> parseStringLiteral();
+        std::unique_ptr<ast::Expr> parsePrefixExpr();
+        std::unique_ptr<ast::Expr> parseInfixExpr(std::unique_ptr<ast::Expr> lhs);
+        std::unique_ptr<ast::Expr> parseBoolean();
+        std::unique_ptr<ast::Expr> parseGroupedExpr();
+        std::unique_ptr<ast::Expr> parseIfExpr();
+        std::unique_ptr<ast::BlockStmt> parseBlockStmt();
+        std::unique_ptr<ast::Expr> parseFuncLiteral();
+        // fnc [name](params) [-> type], ending on its last token
+        std::unique_ptr<ast::FuncLiteral> parseFuncSignature();
+        std::unique_ptr<ast::Expr> parseAsyncFuncLiteral();
+        bool parseFunctionParams(std::vector<std::unique_ptr<ast::Identifier>> &params,
+                                 std::vector<std::string> &types);
+        std::unique_ptr<ast::Expr> parseFunctionCall(std::unique_ptr<ast::Expr> function);
+        std::unique_ptr<ast::Expr> parseArrayLiteral();
+        std::unique_ptr<ast::Expr> parseIndexExpr(std::unique_ptr<ast::Expr> left);
+        std::unique_ptr<ast::Expr> parseHashLiteral();
+        std::vector<std::unique_ptr<ast::Expr>> parseExprList(lex::TokenType end);
     };
 } //cblt::parse
 
-#endif //PARSER_H
\ No newline at end of file
+#endif //PARSER_H
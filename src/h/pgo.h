@@ -0,0 +1,38 @@
+#pragma once
+
+#ifndef PGO_H
+#define PGO_H
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include <string>
+
+namespace cblt::pgo {
+    // -fprofile-generate[=path] bakes counters into the program, the runtime
+    // merges them into path at exit. -fprofile-use=path reads them back as
+    // function entry counts and branch weights for the optimizer
+    void enableGenerate(const std::string &outPath);
+    bool enableUse(const std::string &path, std::string &err);
+    [[nodiscard]] bool generating();
+    [[nodiscard]] bool usingProfile();
+
+    // codegen hooks. sites are numbered per function in codegen order, so a
+    // generate and a use build of the same source agree on the keys
+    void enterFunction(llvm::Function *fn);
+    void leaveFunction();
+    [[nodiscard]] std::string nextSite(const std::string &kind);
+
+    // bumps the counter for site at the builder's insert point
+    void counter(const std::string &site);
+    // taken / total are sites, the not taken edge gets total - taken
+    void weighBranch(llvm::BranchInst *br, const std::string &taken, const std::string &total);
+    // latch of a rotated loop, the back edge gets body - entered
+    void weighLoop(llvm::BranchInst *latch, const std::string &body, const std::string &entered);
+    void weighCall(llvm::CallInst *call, const std::string &site);
+
+    // emits the counter tables and registration ctor, or the profile summary
+    void finishModule(llvm::Module &module);
+}
+
+#endif //PGO_H
@@ -0,0 +1,22 @@
+#pragma once
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "llvm/IR/Module.h"
+#include <string>
+
+namespace cblt::profiler {
+    // --profile[=path] times every fnc call in the compiled program. at exit
+    // the runtime writes calls and inclusive / exclusive time per fnc to path,
+    // and folded stacks for flamegraph tools to path.folded
+    void enable(const std::string &outPath);
+    [[nodiscard]] bool enabled();
+
+    // runs after optimization, so fncs the inliner folded into their callers
+    // cost nothing and are timed as part of them. so are small fncs without
+    // loops, see profiler.cpp
+    void instrument(llvm::Module &module);
+}
+
+#endif //PROFILER_H
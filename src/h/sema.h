@@ -0,0 +1,74 @@
+#pragma once
+
+#ifndef SEMA_H
+#define SEMA_H
+
+#include "../h/ast.h"
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace cblt::sema {
+    // how a call that is the operand of a return in caller runs, the rule
+    // codegen lowers by and -Wnon-tail-recursion checks against. callee is
+    // the top level fnc the call names, null for fnc values and externs
+    enum struct TailCall {
+        NONE, // an ordinary call, the caller's frame stays until it returns
+        LOOP, // self recursion, rebinds the params and branches back to the top
+        MUSTTAIL, // replaces the caller's frame at every opt level
+    };
+    // a musttail call needs the caller's prototype, and a str, []num or fnc
+    // arg can't point into the frame it replaces: it has to be a literal or a
+    // param of the caller's that is never assigned and that self recursion
+    // only passes the same kind of value
+    TailCall tailCallKind(ast::FuncLiteral &caller, ast::CallExpr &call, const ast::FuncLiteral *callee);
+
+    // -Wnon-tail-recursion, flags calls that recurse (directly or through a
+    // cycle of top level fncs) and don't run as a loop or a musttail call
+    std::vector<std::string> checkTailRecursion(ast::Program &program);
+
+    // the same check fed one program level statement at a time, only the
+    // call graph is kept so a streaming compile can free each statement.
+    // fncs are the signatures of every top level fnc, bodies aren't read
+    class TailRecursionCheck {
+        struct CallSite {
+            std::string callee;
+            bool returned; // the operand of a return
+            bool tail; // a loop or a musttail call
+            int line;
+        };
+
+        std::map<std::string, const ast::FuncLiteral *> signatures;
+        std::map<std::string, std::vector<CallSite>> graph;
+
+        void collectCalls(ast::FuncLiteral &caller, ast::Node *node, bool inTail, std::vector<CallSite> &calls);
+
+    public:
+        explicit TailRecursionCheck(const std::vector<ast::FuncLiteral *> &fncs);
+        void add(ast::Stmt &stmt);
+        [[nodiscard]] std::vector<std::string> finish() const;
+    };
+
+    // marks fnc literals that are only ever called, bound to decls that are
+    // only called, or passed to fnc params that don't escape, so codegen can
+    // keep their environment on the stack and call them directly
+    void analyzeEscapes(ast::Program &program);
+
+    class EscapeAnalysis;
+
+    // analyzeEscapes one program level statement at a time, for streaming
+    // compiles. statements not parsed yet may use any name bound at program
+    // level, so those values escape, and so do args to top level fncs that
+    // haven't been seen. inside a fnc or block the analysis is the same
+    class EscapeStream {
+        std::unique_ptr<EscapeAnalysis> analysis;
+
+    public:
+        EscapeStream();
+        ~EscapeStream();
+        void add(ast::Stmt &stmt);
+    };
+}
+
+#endif //SEMA_H
@@ -0,0 +1,81 @@
+#pragma once
+
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+namespace cblt::timing {
+    // compile phases in pipeline order, a phase nested inside another
+    // (lex inside parse) is accounted exclusively, the parent is paused
+    enum struct Phase {
+        READ,
+        LEX,
+        PARSE,
+        SEMA,
+        IRGEN,
+        OPT,
+        EMIT,
+        COUNT,
+    };
+
+    std::string phaseToString(Phase phase);
+
+    struct PhaseStats {
+        double wallMs = 0;
+        double cpuMs = 0;
+        std::uint64_t allocs = 0;
+        std::uint64_t allocBytes = 0;
+        std::uint64_t entries = 0;
+    };
+
+    // collects per phase stats for --time-report and --mem-report
+    void enableReport();
+    // turns it back off and drops what was collected, for the next compile
+    void disableReport();
+    [[nodiscard]] bool reportEnabled();
+    [[nodiscard]] PhaseStats getStats(Phase phase);
+    void printReport(std::ostream &os);
+
+    // --trace=out.json, chrome/perfetto trace events through llvm's time profiler
+    void enableTrace();
+    [[nodiscard]] bool traceEnabled();
+    bool writeTrace(const std::string &path, std::string &err);
+
+    // times one phase on the calling thread, no-op unless a report or trace is on
+    // traced=false keeps very hot scopes (one per token) out of the trace file
+    class PhaseScope {
+        Phase phase;
+        bool active;
+        bool traced;
+        PhaseScope *parent;
+        double wallStart, cpuStart;
+        std::uint64_t allocStart, bytesStart;
+        PhaseStats acc;
+
+        void pause();
+        void resume();
+
+    public:
+        explicit PhaseScope(Phase phase, bool traced = true);
+        PhaseScope(const PhaseScope &) = delete;
+        PhaseScope &operator=(const PhaseScope &) = delete;
+        ~PhaseScope();
+    };
+
+    // wraps a worker thread so its spans land on their own track in the trace
+    // and its allocations count when the compile tracks them
+    class ThreadScope {
+        bool active;
+
+    public:
+        explicit ThreadScope(const std::string &name);
+        ThreadScope(const ThreadScope &) = delete;
+        ThreadScope &operator=(const ThreadScope &) = delete;
+        ~ThreadScope();
+    };
+}
+
+#endif //TIMING_H
@@ -1,4 +1,5 @@
 #include "../h/ast.h"
+#include <cctype>
 
 using namespace cblt::lex;
 using namespace cblt::ast;
@@ -10,36 +11,43 @@ namespace cblt::ast {
         : token(std::move(token)), value(std::move(value)) {
     }
 
-    [[nodiscard]] std::string Identifier::TokenLiteral() const override {
+    [[nodiscard]] std::string Identifier::TokenLiteral() const {
         return token.literal;
     }
 
-    [[nodiscard]] std::string Identifier::String() const override {
+    [[nodiscard]] std::string Identifier::String() const {
         return value;
     }
 
     // ---------- Program Implementations ---------
-    [[nodiscard]] std::string Program::TokenLiteral() const override {
+    [[nodiscard]] std::string Program::TokenLiteral() const {
         if (!stmts.empty()) {
             return stmts[0]->TokenLiteral();
         }
         return "";
     }
 
-    [[nodiscard]] std::string Program::String() const override {
+    [[nodiscard]] std::string Program::String() const {
         std::string res;
         for (const auto &stmt: stmts) {
+            if (!res.empty()) {
+                res += " ";
+            }
             res += stmt->String();
         }
         return res;
     }
 
     // ---------- Variable Declaration Implementations ---------
-    [[nodiscard]] std::string VarDeclStmt::TokenLiteral() const override {
+    [[nodiscard]] std::string VarDeclStmt::TokenLiteral() const {
         return token.literal;
     }
 
-    [[nodiscard]] std::string VarDeclStmt::String() const override {
+    [[nodiscard]] int VarDeclStmt::TokenLine() const {
+        return token.line;
+    }
+
+    [[nodiscard]] std::string VarDeclStmt::String() const {
         std::string res;
         res += "decl ";
         res += name->String();
@@ -58,21 +66,22 @@ namespace cblt::ast {
         : token(std::move(token)), value(value) {
     }
 
-    [[nodiscard]] std::string NumLiteral::TokenLiteral() const override {
+    [[nodiscard]] std::string NumLiteral::TokenLiteral() const {
         return token.literal;
     }
 
-    [[nodiscard]] std::string NumLiteral::String() const override {
+    [[nodiscard]] std::string NumLiteral::String() const {
         return token.literal;
     }
 
     // ---------- Boolean Implementations ---------
     Boolean::Boolean(bool value) : value(value) {}
-    [[nodiscard]] std::string Boolean::TokenLiteral() const override {
+    Boolean::Boolean(Token token, const bool value) : token(std::move(token)), value(value) {}
+    [[nodiscard]] std::string Boolean::TokenLiteral() const {
         return token.literal;
     }
 
-    [[nodiscard]] std::string Boolean::String() const override {
+    [[nodiscard]] std::string Boolean::String() const {
         return token.literal;
     }
 
@@ -80,15 +89,19 @@ namespace cblt::ast {
 
 
     // ---------- Return Stmt Implementations ---------
-    [[nodiscard]] std::string ReturnStmt::TokenLiteral() const override {
+    [[nodiscard]] std::string ReturnStmt::TokenLiteral() const {
         return  token.literal;
     }
 
-    [[nodiscard]] std::string ReturnStmt::String() const override {
+    [[nodiscard]] int ReturnStmt::TokenLine() const {
+        return token.line;
+    }
+
+    [[nodiscard]] std::string ReturnStmt::String() const {
         std::string res = "";
         res += token.literal;
         if (returnValue) {
-            res += returnValue->String();
+            res += " " + returnValue->String();
         }
 
         res += ';';
@@ -96,11 +109,15 @@ namespace cblt::ast {
     }
 
     // ---------- ExprStmt Implementations ---------
-    [[nodiscard]] std::string ExprStmt::TokenLiteral() const override {
+    [[nodiscard]] std::string ExprStmt::TokenLiteral() const {
         return token.literal;
     }
 
-    [[nodiscard]] std::string ExprStmt::String() const override {
+    [[nodiscard]] int ExprStmt::TokenLine() const {
+        return token.line;
+    }
+
+    [[nodiscard]] std::string ExprStmt::String() const {
         if (expr) {
             return expr->String();
         }
@@ -108,11 +125,15 @@ namespace cblt::ast {
     }
 
     // ---------- BlockStmt Implementations ---------
-    [[nodiscard]] std::string BlockStmt::TokenLiteral() const override {
+    [[nodiscard]] std::string BlockStmt::TokenLiteral() const {
         return  token.literal;
     }
 
-    [[nodiscard]] std::string BlockStmt::String() const override {
+    [[nodiscard]] int BlockStmt::TokenLine() const {
+        return token.line;
+    }
+
+    [[nodiscard]] std::string BlockStmt::String() const {
         std::string res = "{";
         for (const auto &stmt: stmts) {
             res += stmt->String() + " ";
@@ -121,5 +142,249 @@ namespace cblt::ast {
         return res;
     }
 
+    // ---------- WhileStmt Implementations ---------
+    [[nodiscard]] std::string WhileStmt::TokenLiteral() const {
+        return token.literal;
+    }
+
+    [[nodiscard]] int WhileStmt::TokenLine() const {
+        return token.line;
+    }
 
+    [[nodiscard]] std::string WhileStmt::String() const {
+        return "while " + condition->String() + " " + body->String();
+    }
+
+    // ---------- AssignStmt Implementations ---------
+    [[nodiscard]] std::string AssignStmt::TokenLiteral() const {
+        return token.literal;
+    }
+
+    [[nodiscard]] int AssignStmt::TokenLine() const {
+        return token.line;
+    }
+
+    [[nodiscard]] std::string AssignStmt::String() const {
+        return target->String() + " = " + value->String() + ";";
+    }
+
+    // ---------- ExternStmt Implementations ---------
+    [[nodiscard]] std::string ExternStmt::TokenLiteral() const {
+        return token.literal;
+    }
+
+    [[nodiscard]] int ExternStmt::TokenLine() const {
+        return token.line;
+    }
+
+    [[nodiscard]] std::string ExternStmt::String() const {
+        std::string res = token.literal + (pure ? " pure fnc " : " fnc ") + name + "(";
+        for (size_t i = 0; i < parameters.size(); i++) {
+            if (i > 0) {
+                res += ", ";
+            }
+            res += parameters[i]->String();
+            if (!paramTypes[i].empty()) {
+                res += ": " + paramTypes[i];
+            }
+        }
+        res += ")";
+        if (!returnType.empty()) {
+            res += " -> " + returnType;
+        }
+        return res + ";";
+    }
+
+    // ---------- PrefixExpr Implementations ---------
+    [[nodiscard]] std::string PrefixExpr::TokenLiteral() const {
+        return token.literal;
+    }
+
+    [[nodiscard]] std::string PrefixExpr::String() const {
+        // await and spawn are words
+        return "(" + op + (isalpha(op[0]) ? " " : "") + right->String() + ")";
+    }
+
+    // ---------- InfixExpr Implementations ---------
+    [[nodiscard]] std::string InfixExpr::TokenLiteral() const {
+        return token.literal;
+    }
+
+    [[nodiscard]] std::string InfixExpr::String() const {
+        return "(" + lhs->String() + " " + op + " " + rhs->String() + ")";
+    }
+
+    // ---------- IfExpr Implementations ---------
+    [[nodiscard]] std::string IfExpr::TokenLiteral() const {
+        return token.literal;
+    }
+
+    [[nodiscard]] std::string IfExpr::String() const {
+        std::string res = "if " + condition->String() + " " + consequence->String();
+        if (alternative) {
+            res += " else " + alternative->String();
+        }
+        return res;
+    }
+
+    // ---------- FuncLiteral Implementations ---------
+    [[nodiscard]] std::string FuncLiteral::TokenLiteral() const {
+        return token.literal;
+    }
+
+    [[nodiscard]] std::string FuncLiteral::String() const {
+        std::string res = async ? "async " + token.literal : token.literal;
+        if (!name.empty()) {
+            res += " " + name;
+        }
+        res += "(";
+        for (size_t i = 0; i < parameters.size(); i++) {
+            if (i > 0) {
+                res += ", ";
+            }
+            res += parameters[i]->String();
+            if (i < paramTypes.size() && !paramTypes[i].empty()) {
+                res += ": " + paramTypes[i];
+            }
+        }
+        res += ")";
+        if (!returnType.empty()) {
+            res += " -> " + returnType;
+        }
+        res += " " + body->String();
+        return res;
+    }
+
+    // ---------- CallExpr Implementations ---------
+    [[nodiscard]] std::string CallExpr::TokenLiteral() const {
+        return token.literal;
+    }
+
+    [[nodiscard]] std::string CallExpr::String() const {
+        std::string res = function->String() + "(";
+        for (size_t i = 0; i < args.size(); i++) {
+            if (i > 0) {
+                res += ", ";
+            }
+            res += args[i]->String();
+        }
+        res += ")";
+        return res;
+    }
+
+    // ---------- StringLiteral Implementations ---------
+    [[nodiscard]] std::string StringLiteral::TokenLiteral() const {
+        return token.literal;
+    }
+
+    [[nodiscard]] std::string StringLiteral::String() const {
+        return "\"" + value + "\"";
+    }
+
+    // ---------- ArrayLiteral Implementations ---------
+    [[nodiscard]] std::string ArrayLiteral::TokenLiteral() const {
+        return token.literal;
+    }
+
+    [[nodiscard]] std::string ArrayLiteral::String() const {
+        std::string res = "[";
+        for (size_t i = 0; i < elements.size(); i++) {
+            if (i > 0) {
+                res += ", ";
+            }
+            res += elements[i]->String();
+        }
+        res += "]";
+        return res;
+    }
+
+    // ---------- IndexExpr Implementations ---------
+    [[nodiscard]] std::string IndexExpr::TokenLiteral() const {
+        return token.literal;
+    }
+
+    [[nodiscard]] std::string IndexExpr::String() const {
+        return "(" + left->String() + "[" + index->String() + "])";
+    }
+
+    // ---------- HashLiteral Implementations ---------
+    [[nodiscard]] std::string HashLiteral::TokenLiteral() const {
+        return token.literal;
+    }
+
+    [[nodiscard]] std::string HashLiteral::String() const {
+        std::string res = "{";
+        for (size_t i = 0; i < pairs.size(); i++) {
+            if (i > 0) {
+                res += ", ";
+            }
+            res += pairs[i].first->String() + ": " + pairs[i].second->String();
+        }
+        res += "}";
+        return res;
+    }
+
+    // ---------- Traversal ---------
+    template<typename T>
+    static void eachOf(const std::vector<std::unique_ptr<T>> &nodes, const std::function<void(Node *)> &fn) {
+        for (const auto &node: nodes) {
+            if (node) {
+                fn(node.get());
+            }
+        }
+    }
+
+    static void eachOf(Node *node, const std::function<void(Node *)> &fn) {
+        if (node) {
+            fn(node);
+        }
+    }
+
+    void forEachChild(Node *node, const std::function<void(Node *)> &fn) {
+        if (auto *n = dynamic_cast<Program *>(node)) {
+            eachOf(n->stmts, fn);
+        } else if (auto *n = dynamic_cast<VarDeclStmt *>(node)) {
+            eachOf(n->name.get(), fn);
+            eachOf(n->value.get(), fn);
+        } else if (auto *n = dynamic_cast<ReturnStmt *>(node)) {
+            eachOf(n->returnValue.get(), fn);
+        } else if (auto *n = dynamic_cast<ExprStmt *>(node)) {
+            eachOf(n->expr.get(), fn);
+        } else if (auto *n = dynamic_cast<BlockStmt *>(node)) {
+            eachOf(n->stmts, fn);
+        } else if (auto *n = dynamic_cast<WhileStmt *>(node)) {
+            eachOf(n->condition.get(), fn);
+            eachOf(n->body.get(), fn);
+        } else if (auto *n = dynamic_cast<AssignStmt *>(node)) {
+            eachOf(n->target.get(), fn);
+            eachOf(n->value.get(), fn);
+        } else if (auto *n = dynamic_cast<ExternStmt *>(node)) {
+            eachOf(n->parameters, fn);
+        } else if (auto *n = dynamic_cast<PrefixExpr *>(node)) {
+            eachOf(n->right.get(), fn);
+        } else if (auto *n = dynamic_cast<InfixExpr *>(node)) {
+            eachOf(n->lhs.get(), fn);
+            eachOf(n->rhs.get(), fn);
+        } else if (auto *n = dynamic_cast<IfExpr *>(node)) {
+            eachOf(n->condition.get(), fn);
+            eachOf(n->consequence.get(), fn);
+            eachOf(n->alternative.get(), fn);
+        } else if (auto *n = dynamic_cast<FuncLiteral *>(node)) {
+            eachOf(n->parameters, fn);
+            eachOf(n->body.get(), fn);
+        } else if (auto *n = dynamic_cast<CallExpr *>(node)) {
+            eachOf(n->function.get(), fn);
+            eachOf(n->args, fn);
+        } else if (auto *n = dynamic_cast<ArrayLiteral *>(node)) {
+            eachOf(n->elements, fn);
+        } else if (auto *n = dynamic_cast<IndexExpr *>(node)) {
+            eachOf(n->left.get(), fn);
+            eachOf(n->index.get(), fn);
+        } else if (auto *n = dynamic_cast<HashLiteral *>(node)) {
+            for (const auto &[key, value]: n->pairs) {
+                eachOf(key.get(), fn);
+                eachOf(value.get(), fn);
+            }
+        }
+    }
 } // cblt::ast
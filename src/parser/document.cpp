@@ -0,0 +1,284 @@
+#include "../h/document.h"
+#include <algorithm>
+#include <cctype>
+#include <iterator>
+
+using namespace cblt::lex;
+using namespace cblt::ast;
+
+namespace cblt::parse {
+    template<typename N>
+    static Token *tokenIf(Node *node) {
+        auto *n = dynamic_cast<N *>(node);
+        return n ? &n->token : nullptr;
+    }
+
+    template<typename... Nodes>
+    static Token *tokenOf(Node *node) {
+        Token *token = nullptr;
+        (void) ((token = tokenIf<Nodes>(node)) || ...);
+        return token;
+    }
+
+    static void shiftLines(Node *node, const int by) {
+        if (Token *token = tokenOf<Identifier, VarDeclStmt, ReturnStmt, ExprStmt, BlockStmt, WhileStmt, AssignStmt,
+            ExternStmt, NumLiteral, Boolean, PrefixExpr, InfixExpr, IfExpr, FuncLiteral, CallExpr, StringLiteral, ArrayLiteral,
+            IndexExpr, HashLiteral>(node)) {
+            token->line += by;
+        }
+        forEachChild(node, [by](Node *child) { shiftLines(child, by); });
+    }
+
+    // every error ends in line=N, moved along with the tokens it is about
+    static void shiftLines(std::string &message, const int by) {
+        for (std::size_t at = message.find("line="); at != std::string::npos; at = message.find("line=", at)) {
+            at += 5;
+            std::size_t end = at;
+            while (end < message.size() && isdigit(message[end])) {
+                end++;
+            }
+            if (end > at) {
+                message.replace(at, end - at, std::to_string(std::stoi(message.substr(at, end - at)) + by));
+            }
+        }
+    }
+
+    // v[from, to) becomes with, moving the tail only when the length changes
+    template<typename T>
+    static void splice(std::vector<T> &v, const std::size_t from, const std::size_t to, const std::vector<T> &with) {
+        if (to - from == with.size()) {
+            std::copy(with.begin(), with.end(), v.begin() + static_cast<std::ptrdiff_t>(from));
+            return;
+        }
+        v.erase(v.begin() + static_cast<std::ptrdiff_t>(from), v.begin() + static_cast<std::ptrdiff_t>(to));
+        v.insert(v.begin() + static_cast<std::ptrdiff_t>(from), with.begin(), with.end());
+    }
+
+    Document::Document(std::string text) : lexer(std::move(text)), parser(tokens) {
+        tokens.source = lexer.getInput();
+        do {
+            lexer.lexInto(tokens);
+            for (std::string &err: lexer.takeErrors()) {
+                lexErrors.push_back({tokens.start(tokens.size() - 1), std::move(err)});
+            }
+        } while (tokens.kinds.back() != TokenType::EoF);
+
+        std::vector<Unit> fresh;
+        reparse(0, 0, 0, fresh, prog.stmts);
+        units = std::move(fresh);
+    }
+
+    std::size_t Document::relex(const std::size_t offset, const int line, const std::size_t syncFrom,
+                                const std::ptrdiff_t delta, TokenBuffer &buf, std::vector<LexError> &errs) {
+        lexer.seek(offset, line);
+        std::size_t old = syncFrom;
+        // the new EoF lines up with the old one if nothing before it did
+        for (;;) {
+            lexer.lexInto(buf);
+            std::vector<std::string> got = lexer.takeErrors();
+            const std::size_t last = buf.size() - 1;
+            const auto start = static_cast<std::ptrdiff_t>(buf.start(last));
+            while (static_cast<std::ptrdiff_t>(tokens.start(old)) + delta < start) {
+                old++;
+            }
+            if (static_cast<std::ptrdiff_t>(tokens.start(old)) + delta == start) {
+                return old;
+            }
+            for (std::string &err: got) {
+                errs.push_back({static_cast<std::uint32_t>(start), std::move(err)});
+            }
+        }
+    }
+
+    std::size_t Document::reparse(const std::size_t begin, const std::size_t syncFrom, const std::ptrdiff_t delta,
+                                  std::vector<Unit> &fresh, std::vector<std::unique_ptr<Stmt>> &stmts) {
+        parser.seek(begin);
+        std::size_t old = syncFrom;
+        for (;;) {
+            const auto at = static_cast<std::ptrdiff_t>(parser.position());
+            while (old < units.size() && static_cast<std::ptrdiff_t>(units[old].begin) + delta < at) {
+                old++;
+            }
+            if (old < units.size() && static_cast<std::ptrdiff_t>(units[old].begin) + delta == at) {
+                return old;
+            }
+            if (parser.curTokenIs(TokenType::EoF)) {
+                return units.size();
+            }
+
+            auto stmt = parser.parseStmt();
+            parser.nextToken();
+            fresh.push_back({
+                static_cast<std::uint32_t>(at), static_cast<std::uint32_t>(parser.position()), stmt != nullptr, 0,
+                parser.takeErrors()
+            });
+            if (stmt) {
+                stmts.push_back(std::move(stmt));
+            }
+        }
+    }
+
+    bool Document::edit(const std::size_t offset, const std::size_t removed, const std::string_view inserted) {
+        if (offset > lexer.getInputSize() || removed > lexer.getInputSize() - offset) {
+            return false;
+        }
+        const auto delta = static_cast<std::ptrdiff_t>(inserted.size()) - static_cast<std::ptrdiff_t>(removed);
+
+        // re-lex from the last token starting before the edit, it may run into
+        // it. old tokens from the first one starting after the edit can be kept
+        const auto firstAt = [this](const std::size_t at) {
+            std::size_t i = std::lower_bound(tokens.offsets.begin(), tokens.offsets.end(), at) - tokens.offsets.begin();
+            // a str's offset is after its quote
+            if (i < tokens.size() && tokens.start(i) < at) {
+                i++;
+            }
+            return i;
+        };
+        std::size_t first = firstAt(offset);
+        std::size_t restart = 0;
+        int line = 1;
+        if (first > 0) {
+            first--;
+            restart = tokens.start(first);
+            line = tokens.lines[first];
+        }
+        const std::size_t syncFrom = firstAt(offset + removed);
+
+        lexer.replace(offset, removed, inserted);
+        tokens.source = lexer.getInput();
+
+        TokenBuffer fresh;
+        std::vector<LexError> freshErrors;
+        const std::size_t synced = relex(restart, line, syncFrom, delta, fresh, freshErrors);
+        // the token that lined up is the old one again
+        const int lineShift = fresh.lines.back() - tokens.lines[synced];
+        if (fresh.kinds.back() == TokenType::NUM) {
+            fresh.numTokens.pop_back();
+            fresh.numValues.pop_back();
+        }
+        fresh.kinds.pop_back();
+        fresh.offsets.pop_back();
+        fresh.lengths.pop_back();
+        fresh.lines.pop_back();
+        const std::uint32_t syncedStart = tokens.start(synced);
+        const auto tokenShift = static_cast<std::ptrdiff_t>(fresh.size()) - static_cast<std::ptrdiff_t>(synced - first);
+
+        // lex errors of the replaced tokens go, the later ones move
+        const auto errorAt = [this](const std::uint32_t start) {
+            return std::lower_bound(lexErrors.begin(), lexErrors.end(), start,
+                                    [](const LexError &err, const std::uint32_t s) { return err.start < s; });
+        };
+        const auto errorsFrom = errorAt(static_cast<std::uint32_t>(restart));
+        const auto errorsTo = errorAt(syncedStart);
+        for (auto it = errorsTo; it != lexErrors.end(); ++it) {
+            it->start = static_cast<std::uint32_t>(it->start + delta);
+            if (lineShift) {
+                shiftLines(it->message, lineShift);
+            }
+        }
+        lexErrors.insert(lexErrors.erase(errorsFrom, errorsTo), std::make_move_iterator(freshErrors.begin()),
+                         std::make_move_iterator(freshErrors.end()));
+
+        // tokens [first, synced) are replaced
+        const auto numFrom = std::lower_bound(tokens.numTokens.begin(), tokens.numTokens.end(),
+                                              static_cast<std::uint32_t>(first)) - tokens.numTokens.begin();
+        const auto numTo = std::lower_bound(tokens.numTokens.begin(), tokens.numTokens.end(),
+                                            static_cast<std::uint32_t>(synced)) - tokens.numTokens.begin();
+        for (auto i = static_cast<std::size_t>(numTo); i < tokens.numTokens.size(); i++) {
+            tokens.numTokens[i] = static_cast<std::uint32_t>(tokens.numTokens[i] + tokenShift);
+        }
+        for (std::uint32_t &index: fresh.numTokens) {
+            index += static_cast<std::uint32_t>(first);
+        }
+        splice(tokens.numTokens, numFrom, numTo, fresh.numTokens);
+        splice(tokens.numValues, numFrom, numTo, fresh.numValues);
+
+        splice(tokens.kinds, first, synced, fresh.kinds);
+        splice(tokens.offsets, first, synced, fresh.offsets);
+        splice(tokens.lengths, first, synced, fresh.lengths);
+        splice(tokens.lines, first, synced, fresh.lines);
+        for (std::size_t i = first + fresh.size(); i < tokens.size(); i++) {
+            tokens.offsets[i] = static_cast<std::uint32_t>(tokens.offsets[i] + delta);
+            tokens.lines[i] += lineShift;
+        }
+
+        // reparse from the first statement that read a replaced token, its
+        // lookahead included, until a boundary lines up with an old one
+        const std::size_t dirty = std::lower_bound(units.begin(), units.end(), first,
+                                                   [](const Unit &unit, const std::size_t i) {
+                                                       return unit.end < i;
+                                                   }) - units.begin();
+        const std::size_t reuseFrom = std::lower_bound(units.begin(), units.end(), synced,
+                                                       [](const Unit &unit, const std::size_t i) {
+                                                           return unit.begin < i;
+                                                       }) - units.begin();
+        std::vector<Unit> freshUnits;
+        std::vector<std::unique_ptr<Stmt>> freshStmts;
+        const std::size_t reused = reparse(dirty < units.size() ? units[dirty].begin : 0, reuseFrom, tokenShift,
+                                           freshUnits, freshStmts);
+
+        const auto stmtsIn = [this](const std::size_t from, const std::size_t to) {
+            return std::count_if(units.begin() + static_cast<std::ptrdiff_t>(from),
+                                 units.begin() + static_cast<std::ptrdiff_t>(to),
+                                 [](const Unit &unit) { return unit.hasStmt; });
+        };
+        const auto stmtFrom = stmtsIn(0, dirty);
+        const auto stmtTo = stmtFrom + stmtsIn(dirty, reused);
+        prog.stmts.erase(prog.stmts.begin() + stmtFrom, prog.stmts.begin() + stmtTo);
+        prog.stmts.insert(prog.stmts.begin() + stmtFrom, std::make_move_iterator(freshStmts.begin()),
+                          std::make_move_iterator(freshStmts.end()));
+
+        for (std::size_t i = reused; i < units.size(); i++) {
+            Unit &unit = units[i];
+            unit.begin = static_cast<std::uint32_t>(unit.begin + tokenShift);
+            unit.end = static_cast<std::uint32_t>(unit.end + tokenShift);
+            if (lineShift) {
+                unit.staleLines += lineShift;
+                for (std::string &err: unit.errors) {
+                    shiftLines(err, lineShift);
+                }
+            }
+        }
+        units.erase(units.begin() + static_cast<std::ptrdiff_t>(dirty),
+                    units.begin() + static_cast<std::ptrdiff_t>(reused));
+        units.insert(units.begin() + static_cast<std::ptrdiff_t>(dirty), std::make_move_iterator(freshUnits.begin()),
+                     std::make_move_iterator(freshUnits.end()));
+        return true;
+    }
+
+    std::string_view Document::text() const {
+        return lexer.getInput();
+    }
+
+    std::vector<std::string> Document::diagnostics() const {
+        std::vector<std::string> out;
+        for (const LexError &err: lexErrors) {
+            out.push_back(err.message);
+        }
+        for (const Unit &unit: units) {
+            out.insert(out.end(), unit.errors.begin(), unit.errors.end());
+        }
+        return out;
+    }
+
+    // statement lines are shifted here rather than on every edit, a run of
+    // typing above a long file would otherwise walk all of its ast each time
+    Program &Document::program() {
+        std::size_t stmt = 0;
+        for (Unit &unit: units) {
+            if (!unit.hasStmt) {
+                continue;
+            }
+            if (unit.staleLines) {
+                shiftLines(prog.stmts[stmt].get(), unit.staleLines);
+                unit.staleLines = 0;
+            }
+            stmt++;
+        }
+        return prog;
+    }
+
+    const TokenBuffer &Document::tokenBuffer() const {
+        return tokens;
+    }
+} // cblt::parse
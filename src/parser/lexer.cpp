@@ -1,4 +1,7 @@
 #include "../h/lexer.h"
+#include <algorithm>
+#include <charconv>
+#include <utility>
 
 namespace cblt::lex {
     std::string tokenTypeToString(const TokenType type) {
@@ -8,6 +11,10 @@ namespace cblt::lex {
             case TokenType::STRING: return "STRING";
             case TokenType::DECLARE: return "DECLARE";
 
+            case TokenType::NUM_TYPE: return "NUM_TYPE";
+            case TokenType::BOOL_TYPE: return "BOOL_TYPE";
+            case TokenType::STRING_TYPE: return "STRING_TYPE";
+
             case TokenType::ASSIGN: return "ASSIGN";
             case TokenType::PLUS: return "PLUS";
             case TokenType::MINUS: return "MINUS";
@@ -51,6 +58,10 @@ namespace cblt::lex {
             case TokenType::CONTINUE: return "CONTINUE";
             case TokenType::TRUE: return "TRUE";
             case TokenType::FALSE: return "FALSE";
+            case TokenType::ASYNC: return "ASYNC";
+            case TokenType::AWAIT: return "AWAIT";
+            case TokenType::SPAWN: return "SPAWN";
+            case TokenType::EXTERN: return "EXTERN";
 
             case TokenType::NEWLINE: return "NEWLINE";
             case TokenType::ILLEGAL: return "ILLEGAL";
@@ -85,7 +96,14 @@ namespace cblt::lex {
               {"continue", TokenType::CONTINUE},
               {"true", TokenType::TRUE},
               {"false", TokenType::FALSE},
+              {"async", TokenType::ASYNC},
+              {"await", TokenType::AWAIT},
+              {"spawn", TokenType::SPAWN},
+              {"extern", TokenType::EXTERN},
               {"decl", TokenType::DECLARE},
+              {"num", TokenType::NUM_TYPE},
+              {"bool", TokenType::BOOL_TYPE},
+              {"str", TokenType::STRING_TYPE},
           }) {
         readChar();
     }
@@ -109,171 +127,265 @@ namespace cblt::lex {
         }
     }
 
+    // bytes a string holds outside of itself, zero while it fits the small buffer
+    static size_t heapBytes(const std::string &str) {
+        static const size_t inlineCapacity = std::string().capacity();
+        return str.capacity() > inlineCapacity ? str.capacity() + 1 : 0;
+    }
+
+    template<typename T>
+    static size_t vectorBytes(const std::vector<T> &vec) {
+        return vec.capacity() * sizeof(T);
+    }
+
+    std::size_t TokenBuffer::size() const {
+        return first + kinds.size();
+    }
+
+    std::string_view TokenBuffer::text(const std::size_t i) const {
+        return source.substr(offsets[i - first], lengths[i - first]);
+    }
+
+    std::uint32_t TokenBuffer::start(const std::size_t i) const {
+        return offsets[i - first] - (kinds[i - first] == TokenType::STRING);
+    }
+
+    double TokenBuffer::number(const std::size_t i) const {
+        const auto it = std::lower_bound(numTokens.begin(), numTokens.end(), static_cast<std::uint32_t>(i));
+        return numValues[it - numTokens.begin()];
+    }
+
+    Token TokenBuffer::token(const std::size_t i) const {
+        return {kinds[i - first], std::string(text(i)), lines[i - first]};
+    }
+
+    std::size_t TokenBuffer::bytes() const {
+        return vectorBytes(kinds) + vectorBytes(offsets) + vectorBytes(lengths) + vectorBytes(lines) +
+               vectorBytes(numTokens) + vectorBytes(numValues);
+    }
+
+    // the rest is copied into arrays of its own size so the old ones are
+    // freed, erasing the front would keep their capacity
+    template<typename T>
+    static void dropFront(std::vector<T> &vec, const std::size_t n) {
+        std::vector<T> rest(vec.begin() + static_cast<std::ptrdiff_t>(n), vec.end());
+        vec.swap(rest);
+    }
+
+    void TokenBuffer::dropBefore(const std::size_t index) {
+        const std::size_t n = index - first;
+        const auto nums = static_cast<std::size_t>(
+            std::lower_bound(numTokens.begin(), numTokens.end(), static_cast<std::uint32_t>(index)) -
+            numTokens.begin());
+        dropFront(kinds, n);
+        dropFront(offsets, n);
+        dropFront(lengths, n);
+        dropFront(lines, n);
+        dropFront(numTokens, nums);
+        dropFront(numValues, nums);
+        first = index;
+    }
+
     Token Lexer::nextToken() {
-        Token tok;
+        const Lexeme lx = scan();
+        Token tok(lx.type, input.substr(lx.offset, lx.length), lx.line);
+        tokenCount++;
+        tokenBytes += sizeof(Token) + heapBytes(tok.literal);
+        return tok;
+    }
+
+    TokenBuffer Lexer::tokenize() {
+        TokenBuffer buf;
+        buf.source = input;
+        // about one token per five bytes of source, saves most of the regrowth
+        const size_t guess = input.size() / 5 + 1;
+        buf.kinds.reserve(guess);
+        buf.offsets.reserve(guess);
+        buf.lengths.reserve(guess);
+        buf.lines.reserve(guess);
+
+        do {
+            lexInto(buf);
+        } while (buf.kinds.back() != TokenType::EoF);
+
+        tokenCount += buf.size();
+        tokenBytes += buf.bytes();
+        return buf;
+    }
+
+    void Lexer::lexInto(TokenBuffer &buf) {
+        const Lexeme lx = scan();
+        if (lx.type == TokenType::NUM) {
+            double value = 0;
+            const char *first = input.data() + lx.offset;
+            const char *last = first + lx.length;
+            if (const auto [ptr, ec] = std::from_chars(first, last, value); ec != std::errc() || ptr != last) {
+                errors.emplace_back("Lex error: could not parse " + input.substr(lx.offset, lx.length) +
+                                    " as num, line=" + std::to_string(lx.line));
+            }
+            buf.numTokens.push_back(static_cast<std::uint32_t>(buf.size()));
+            buf.numValues.push_back(value);
+        }
+        buf.kinds.push_back(lx.type);
+        buf.offsets.push_back(lx.offset);
+        buf.lengths.push_back(lx.length);
+        buf.lines.push_back(lx.line);
+    }
+
+    void Lexer::replace(const std::size_t offset, const std::size_t removed, const std::string_view inserted) {
+        input.replace(offset, removed, inserted);
+    }
+
+    void Lexer::seek(const std::size_t offset, const int line) {
+        readPos = offset;
+        this->line = line;
+        readChar();
+    }
+
+    std::string_view Lexer::getInput() const {
+        return input;
+    }
+
+    std::vector<std::string> Lexer::takeErrors() {
+        return std::exchange(errors, {});
+    }
+
+    // the two char token when the next char is second, e.g. == after =
+    TokenType Lexer::oneOrTwo(const char second, const TokenType two, const TokenType one) {
+        if (peekChar() == second) {
+            readChar();
+            return two;
+        }
+        return one;
+    }
+
+    Lexer::Lexeme Lexer::scan() {
         skipWhitespace();
+        auto start = static_cast<std::uint32_t>(pos);
+        TokenType type;
 
         switch (ch) {
             // basic operators
             case '=':
-                if (peekChar() == '=') {
-                    readChar();
-                    tok = newToken(TokenType::EQ, "==", line);
-                } else {
-                    tok = newToken(TokenType::ASSIGN, std::string(1, ch), line);
-                }
+                type = oneOrTwo('=', TokenType::EQ, TokenType::ASSIGN);
                 break;
             case '+':
-                tok = newToken(TokenType::PLUS, std::string(1, ch), line);
+                type = TokenType::PLUS;
                 break;
             case '-':
-                if (peekChar() == '>') {
-                    readChar();
-                    tok = newToken(TokenType::TERNARY, "->", line);
-                } else {
-                    tok = newToken(TokenType::MINUS, std::string(1, ch), line);
-                }
+                type = oneOrTwo('>', TokenType::TERNARY, TokenType::MINUS);
                 break;
             case '*':
-                tok = newToken(TokenType::ASTERISK, std::string(1, ch), line);
+                type = TokenType::ASTERISK;
                 break;
             case '/':
                 if (peekChar() == '/') {
-                    while (ch != '\n') {
+                    // comments run to end of line, lex whatever follows them
+                    while (ch != '\n' && ch != 0) {
                         readChar();
                     }
-                    readChar();
-                } else {
-                    tok = newToken(TokenType::SLASH, std::string(1, ch), line);
+                    return scan();
                 }
+                type = TokenType::SLASH;
                 break;
             case '%':
-                tok = newToken(TokenType::PERCENT, std::string(1, ch), line);
+                type = TokenType::PERCENT;
                 break;
 
             // braces, brackets etc
             case '(':
-                tok = newToken(TokenType::LPAREN, std::string(1, ch), line);
+                type = TokenType::LPAREN;
                 break;
             case ')':
-                tok = newToken(TokenType::RPAREN, std::string(1, ch), line);
+                type = TokenType::RPAREN;
                 break;
             case '{':
-                tok = newToken(TokenType::LBRACE, std::string(1, ch), line);
+                type = TokenType::LBRACE;
                 break;
             case '}':
-                tok = newToken(TokenType::RBRACE, std::string(1, ch), line);
+                type = TokenType::RBRACE;
                 break;
             case '[':
-                tok = newToken(TokenType::LBRACKET, std::string(1, ch), line);
+                type = TokenType::LBRACKET;
                 break;
             case ']':
-                tok = newToken(TokenType::RBRACKET, std::string(1, ch), line);
+                type = TokenType::RBRACKET;
                 break;
 
             // statement separators, other char/op etc
             case ';':
-                tok = newToken(TokenType::SEMICOLON, std::string(1, ch), line);
+                type = TokenType::SEMICOLON;
                 break;
             case ':':
-                tok = newToken(TokenType::COLON, std::string(1, ch), line);
+                type = TokenType::COLON;
                 break;
             case ',':
-                tok = newToken(TokenType::COMMA, std::string(1, ch), line);
+                type = TokenType::COMMA;
                 break;
             case '!':
-                if (peekChar() == '=') {
-                    readChar();
-                    tok = newToken(TokenType::NEQ, "!=", line);
-                } else {
-                    tok = newToken(TokenType::BANG, std::string(1, ch), line);
-                }
+                type = oneOrTwo('=', TokenType::NEQ, TokenType::BANG);
                 break;
             case '|':
-                if (peekChar() == '|') {
-                    readChar();
-                    tok = newToken(TokenType::OR, "||", line);
-                } else {
-                    tok = newToken(TokenType::BAR, std::string(1, ch), line);
-                }
+                type = oneOrTwo('|', TokenType::OR, TokenType::BAR);
                 break;
             case '&':
-                if (peekChar() == '&') {
-                    readChar();
-                    tok = newToken(TokenType::AND, "&&", line);
-                } else {
-                    tok = newToken(TokenType::AMPERSAND, std::string(1, ch), line);
-                }
+                type = oneOrTwo('&', TokenType::AND, TokenType::AMPERSAND);
                 break;
             case '^':
-                tok = newToken(TokenType::CIRCUMFLEX, std::string(1, ch), line);
+                type = TokenType::CIRCUMFLEX;
                 break;
             case '.':
-                tok = newToken(TokenType::DOT, std::string(1, ch), line);
+                type = TokenType::DOT;
                 break;
             case '$':
-                tok = newToken(TokenType::DOLLAR, std::string(1, ch), line);
+                type = TokenType::DOLLAR;
                 break;
 
             // boolean operators
             case '>':
-                if (peekChar() == '=') {
-                    readChar();
-                    tok = newToken(TokenType::GTE, ">=", line);
-                } else {
-                    tok = newToken(TokenType::GT, std::string(1, ch), line);
-                }
-                break;
-            case '"':
-                tok = newToken(TokenType::STRING, readString(), line);
+                type = oneOrTwo('=', TokenType::GTE, TokenType::GT);
                 break;
             case '<':
-                if (peekChar() == '=') {
-                    readChar();
-                    tok = newToken(TokenType::LTE, "<=", line);
-                } else {
-                    tok = newToken(TokenType::LT, std::string(1, ch), line);
-                }
+                type = oneOrTwo('=', TokenType::LTE, TokenType::LT);
                 break;
+            case '"': {
+                // the literal is what's between the quotes
+                const std::string_view str = readString();
+                const Lexeme lx{TokenType::STRING, start + 1, static_cast<std::uint32_t>(str.size()), line};
+                readChar();
+                return lx;
+            }
 
             // special cases
             case 0:
-                tok.literal = "";
-                tok.type = TokenType::EoF;
-                tok.line = line;
-                break;
+                return {TokenType::EoF, static_cast<std::uint32_t>(input.size()), 0, line};
             default: {
                 if (isalpha(ch)) {
-                    tok.literal = readIdent();
-                    if (keywords.find(tok.literal) != keywords.end()) {
-                        tok.type = keywords[tok.literal];
-                    } else {
-                        tok.type = TokenType::IDENT;
-                    }
-                    tok.line = line;
-                    return tok;
+                    const std::string_view ident = readIdent();
+                    const auto it = keywords.find(ident);
+                    type = it != keywords.end() ? it->second : TokenType::IDENT;
+                    return {type, start, static_cast<std::uint32_t>(ident.size()), line};
                 }
                 if (isdigit(ch)) {
-                    std::vector<std::string> res = readNumber();
-                    if (res[1] == "inv") {
-                        tok = newToken(TokenType::ILLEGAL, res[0], line);
+                    type = TokenType::NUM;
+                    if (!readNumber()) {
+                        type = TokenType::ILLEGAL;
                         std::string err = "Lex error: illegal num literal, num must have one decimal\nline=" +
                                           std::to_string(line) + ", expected=FLOAT, got=ILLEGAL";
                         errors.emplace_back(err);
-                    } else {
-                        tok = newToken(TokenType::NUM, res[0], line);
                     }
-                    return tok;
+                    return {type, start, static_cast<std::uint32_t>(pos) - start, line};
                 }
                 std::string err = "Lex error: unknown symbol: " +
-                                  tok.literal + ", line=" + std::to_string(line) +
+                                  std::string(1, ch) + ", line=" + std::to_string(line) +
                                   "\nexpected valid TokenType, got=ILLEGAL";
                 errors.emplace_back(err);
-                tok = newToken(TokenType::ILLEGAL, "", line);
+                readChar();
+                return {TokenType::ILLEGAL, start, 0, line};
             }
         }
         readChar();
-        return tok;
+        return {type, start, static_cast<std::uint32_t>(pos) - start, line};
     }
 
 
@@ -290,20 +402,15 @@ namespace cblt::lex {
     }
 
 
-    std::string Lexer::readIdent() {
-        const int start = pos;
+    std::string_view Lexer::readIdent() {
+        const std::size_t start = pos;
         while (isalpha(ch)) {
             readChar();
         }
-        return input.substr(start, pos - start);
+        return std::string_view(input).substr(start, pos - start);
     }
 
-    // We will mimic multiple value return by utilizing a vector
-    // vec[0] -> num value, vec[1] -> "int" || "float"? -> if inv throw error
-    // after rereading could have used static arr
-    // too lazy to fix now
-    std::vector<std::string> Lexer::readNumber() {
-        const int startPosition = pos;
+    bool Lexer::readNumber() {
         bool hasDecimal = false;
         bool isInvalid = false;
 
@@ -317,34 +424,39 @@ namespace cblt::lex {
 
             readChar();
         }
-
-        std::string literal = input.substr(startPosition, pos - startPosition);
-        std::string valid;
-
-        std::string type;
-        if (isInvalid) {
-            valid = "inv";
-        } else {
-            valid = "valid";
-        }
-
-        return {literal, valid};
+        return !isInvalid;
     }
 
 
-    std::string Lexer::readString() {
-        std::string res;
+    // leaves ch on the closing quote
+    std::string_view Lexer::readString() {
         readChar();
+        const std::size_t start = pos;
         while (ch != '"' && ch != 0) {
-            res += ch;
             readChar();
         }
 
         if (ch == 0) {
             errors.emplace_back("Lex error: unterminated string sequence, line=" + std::to_string(line));
-            return res;
+            return std::string_view(input).substr(start);
         }
 
-        return res;
+        return std::string_view(input).substr(start, pos - start);
+    }
+
+    std::vector<std::string> Lexer::getErrors() const {
+        return errors;
+    }
+
+    size_t Lexer::getInputSize() const {
+        return input.size();
+    }
+
+    size_t Lexer::getTokenCount() const {
+        return tokenCount;
+    }
+
+    size_t Lexer::getTokenBytes() const {
+        return tokenBytes;
     }
 } // cblt::lex
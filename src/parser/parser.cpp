@@ -1,9 +1,713 @@
-#include "../parser/ast.cpp"
-#include "../parser/lexer.cpp"
+#include "../h/parser.h"
+#include "../h/timing.h"
+#include <algorithm>
 #include <unordered_map>
+#include <utility>
 
 using namespace cblt::lex;
+using namespace cblt::ast;
 
-class Parser {
+namespace cblt::parse {
 
-};
+    Parser::Parser(Lexer &lexer) : tokens(owned) {
+        {
+            timing::PhaseScope scope(timing::Phase::LEX);
+            owned = lexer.tokenize();
+        }
+        registerParseFns();
+    }
+
+    Parser::Parser(const TokenBuffer &buffer) : tokens(buffer) {
+        registerParseFns();
+    }
+
+    void Parser::registerParseFns() {
+        registerPrefix(TokenType::IDENT, [this] { return std::unique_ptr<Expr>(parseIdentifier()); });
+        registerPrefix(TokenType::NUM, [this] { return parseNumLiteral(); });
+        registerPrefix(TokenType::STRING, [this] { return parseStringLiteral(); });
+        registerPrefix(TokenType::BANG, [this] { return parsePrefixExpr(); });
+        registerPrefix(TokenType::MINUS, [this] { return parsePrefixExpr(); });
+        registerPrefix(TokenType::TRUE, [this] { return parseBoolean(); });
+        registerPrefix(TokenType::FALSE, [this] { return parseBoolean(); });
+        registerPrefix(TokenType::LPAREN, [this] { return parseGroupedExpr(); });
+        registerPrefix(TokenType::IF, [this] { return parseIfExpr(); });
+        registerPrefix(TokenType::FUNCTION, [this] { return parseFuncLiteral(); });
+        registerPrefix(TokenType::ASYNC, [this] { return parseAsyncFuncLiteral(); });
+        registerPrefix(TokenType::AWAIT, [this] { return parsePrefixExpr(); });
+        registerPrefix(TokenType::SPAWN, [this] { return parsePrefixExpr(); });
+        registerPrefix(TokenType::LBRACKET, [this] { return parseArrayLiteral(); });
+        registerPrefix(TokenType::LBRACE, [this] { return parseHashLiteral(); });
+
+        for (const TokenType tt: {
+                 TokenType::PLUS, TokenType::MINUS, TokenType::ASTERISK, TokenType::SLASH, TokenType::PERCENT,
+                 TokenType::EQ, TokenType::NEQ, TokenType::LT, TokenType::GT, TokenType::LTE, TokenType::GTE,
+                 TokenType::AND, TokenType::OR
+             }) {
+            registerInfix(tt, [this](std::unique_ptr<Expr> lhs) { return parseInfixExpr(std::move(lhs)); });
+        }
+        registerInfix(TokenType::LPAREN, [this](std::unique_ptr<Expr> fn) {
+            return parseFunctionCall(std::move(fn));
+        });
+        registerInfix(TokenType::LBRACKET, [this](std::unique_ptr<Expr> left) {
+            return parseIndexExpr(std::move(left));
+        });
+    }
+
+    void Parser::registerPrefix(const TokenType tt, PrefixParseFn func) {
+        prefixParseFns[tt] = std::move(func);
+    }
+
+    void Parser::registerInfix(const TokenType tt, InfixParseFn func) {
+        infixParseFns[tt] = std::move(func);
+    }
+
+    void Parser::nextToken() {
+        if (cur + 1 < tokens.size()) {
+            cur++;
+        }
+    }
+
+    // ---------- Error Reporting ---------
+    void Parser::peekError(const TokenType tt) {
+        errors.emplace_back("Parse error: expected next token to be " + tokenTypeToString(tt) +
+                            ", got=" + tokenTypeToString(kindAt(cur + 1)) +
+                            ", line=" + std::to_string(lineAt(cur + 1)));
+    }
+
+    void Parser::noPrefixParseFnError(const TokenType tt) {
+        errors.emplace_back("Parse error: no prefix parse function for " + tokenTypeToString(tt) +
+                            ", line=" + std::to_string(lineAt(cur)));
+    }
+
+    std::vector<std::string> Parser::getErrors() const {
+        return errors;
+    }
+
+    // ---------- Token Helpers ---------
+    TokenType Parser::kindAt(const std::size_t i) const {
+        return tokens.kinds[std::min(i, tokens.size() - 1) - tokens.first];
+    }
+
+    int Parser::lineAt(const std::size_t i) const {
+        return tokens.lines[std::min(i, tokens.size() - 1) - tokens.first];
+    }
+
+    Token Parser::curToken() const {
+        return tokens.token(cur);
+    }
+
+    std::string Parser::curLiteral() const {
+        return std::string(tokens.text(cur));
+    }
+
+    int Parser::peekPrecedence() {
+        if (const auto it = precedences.find(kindAt(cur + 1)); it != precedences.end()) {
+            return static_cast<int>(it->second);
+        }
+        return static_cast<int>(Precedence::LOWEST);
+    }
+
+    int Parser::currentPrecedence() {
+        if (const auto it = precedences.find(kindAt(cur)); it != precedences.end()) {
+            return static_cast<int>(it->second);
+        }
+        return static_cast<int>(Precedence::LOWEST);
+    }
+
+    bool Parser::curTokenIs(const TokenType tt) const {
+        return kindAt(cur) == tt;
+    }
+
+    bool Parser::peekTokenIs(const TokenType tt, const std::size_t ahead) const {
+        return kindAt(cur + ahead) == tt;
+    }
+
+    bool Parser::expectPeek(const TokenType tt) {
+        if (peekTokenIs(tt)) {
+            nextToken();
+            return true;
+        }
+        peekError(tt);
+        return false;
+    }
+
+    // ---------- Statements ---------
+    std::unique_ptr<Program> Parser::parseProgram() {
+        auto program = std::make_unique<Program>();
+        while (auto stmt = parseNext()) {
+            program->stmts.push_back(std::move(stmt));
+        }
+        return program;
+    }
+
+    std::unique_ptr<Stmt> Parser::parseNext() {
+        while (!curTokenIs(TokenType::EoF)) {
+            auto stmt = parseStmt();
+            nextToken();
+            if (stmt) {
+                return stmt;
+            }
+        }
+        return nullptr;
+    }
+
+    Parser::Outline Parser::outline() {
+        Outline result;
+        std::unique_ptr<FuncLiteral> pending; // a signature whose body hasn't closed yet
+        int depth = 0;
+        bool stmtStart = true;
+        for (std::size_t i = 0; i < tokens.size(); i++) {
+            const TokenType kind = kindAt(i);
+            if (kind == TokenType::IDENT && kindAt(i + 1) == TokenType::ASSIGN) {
+                result.assigned.insert(std::string(tokens.text(i)));
+            }
+            const std::size_t fnc = kind == TokenType::ASYNC ? i + 1 : i;
+            if (depth == 0 && stmtStart && kindAt(fnc) == TokenType::FUNCTION && kindAt(fnc + 1) == TokenType::IDENT) {
+                seek(fnc);
+                pending = parseFuncSignature();
+                if (pending && peekTokenIs(TokenType::LBRACE)) {
+                    pending->async = kind == TokenType::ASYNC;
+                } else {
+                    pending.reset();
+                }
+            }
+
+            switch (kind) {
+                case TokenType::LBRACE:
+                case TokenType::LPAREN:
+                case TokenType::LBRACKET:
+                    depth++;
+                    break;
+                case TokenType::RBRACE:
+                case TokenType::RPAREN:
+                case TokenType::RBRACKET:
+                    depth--;
+                    break;
+                default:
+                    break;
+            }
+            // a body followed by ( or an operator is an expression, not a declaration
+            if (pending && depth == 0 && kind == TokenType::RBRACE) {
+                if (!precedences.count(kindAt(i + 1)) && kindAt(i + 1) != TokenType::ASSIGN) {
+                    result.fncs.push_back(std::move(pending));
+                }
+                pending.reset();
+            }
+            stmtStart = depth == 0 && (kind == TokenType::SEMICOLON || kind == TokenType::RBRACE);
+        }
+        // errors in a signature are found again when its statement is parsed
+        errors.clear();
+        cur = 0;
+        return result;
+    }
+
+    void Parser::dropParsed() {
+        if (&tokens != &owned) {
+            return;
+        }
+        // waits for half the buffer to be behind, so each token is copied about once
+        if ((cur - owned.first) * 2 >= owned.kinds.size()) {
+            owned.dropBefore(cur);
+        }
+    }
+
+    std::size_t Parser::position() const {
+        return cur;
+    }
+
+    void Parser::seek(const std::size_t index) {
+        cur = std::min(index, tokens.size() - 1);
+    }
+
+    std::vector<std::string> Parser::takeErrors() {
+        return std::exchange(errors, {});
+    }
+
+    std::unique_ptr<Stmt> Parser::parseStmt() {
+        switch (kindAt(cur)) {
+            case TokenType::DECLARE:
+                return parseVarDeclStmt();
+            case TokenType::RETURN:
+                return parseReturnStmt();
+            case TokenType::WHILE:
+                return parseWhileStmt();
+            case TokenType::EXTERN:
+                return parseExternStmt();
+            case TokenType::SEMICOLON:
+                return nullptr;
+            default:
+                return parseExprStmt();
+        }
+    }
+
+    // decl name : type -> value;
+    std::unique_ptr<VarDeclStmt> Parser::parseVarDeclStmt() {
+        auto stmt = std::make_unique<VarDeclStmt>();
+        stmt->token = curToken();
+
+        if (!expectPeek(TokenType::IDENT)) {
+            return nullptr;
+        }
+        stmt->name = parseIdentifier();
+
+        if (peekTokenIs(TokenType::COLON)) {
+            nextToken();
+            nextToken();
+            stmt->type = parseType();
+        }
+
+        if (peekTokenIs(TokenType::TERNARY)) {
+            nextToken();
+            nextToken();
+            stmt->value = parseExpr(static_cast<int>(Precedence::LOWEST));
+        }
+
+        if (peekTokenIs(TokenType::SEMICOLON)) {
+            nextToken();
+        }
+        return stmt;
+    }
+
+    std::unique_ptr<ReturnStmt> Parser::parseReturnStmt() {
+        auto stmt = std::make_unique<ReturnStmt>();
+        stmt->token = curToken();
+
+        if (peekTokenIs(TokenType::SEMICOLON) || peekTokenIs(TokenType::RBRACE)) {
+            if (peekTokenIs(TokenType::SEMICOLON)) {
+                nextToken();
+            }
+            return stmt;
+        }
+
+        nextToken();
+        stmt->returnValue = parseExpr(static_cast<int>(Precedence::LOWEST));
+
+        if (peekTokenIs(TokenType::SEMICOLON)) {
+            nextToken();
+        }
+        return stmt;
+    }
+
+    // while condition { body }
+    std::unique_ptr<WhileStmt> Parser::parseWhileStmt() {
+        auto stmt = std::make_unique<WhileStmt>();
+        stmt->token = curToken();
+
+        nextToken();
+        stmt->condition = parseExpr(static_cast<int>(Precedence::LOWEST));
+        if (!stmt->condition || !expectPeek(TokenType::LBRACE)) {
+            return nullptr;
+        }
+        stmt->body = parseBlockStmt();
+        return stmt;
+    }
+
+    // extern [pure] fnc name(a: num) -> num; pure is only a keyword here
+    std::unique_ptr<ExternStmt> Parser::parseExternStmt() {
+        auto stmt = std::make_unique<ExternStmt>();
+        stmt->token = curToken();
+
+        if (peekTokenIs(TokenType::IDENT) && tokens.text(cur + 1) == "pure") {
+            nextToken();
+            stmt->pure = true;
+        }
+        if (!expectPeek(TokenType::FUNCTION) || !expectPeek(TokenType::IDENT)) {
+            return nullptr;
+        }
+        stmt->name = curLiteral();
+        if (!expectPeek(TokenType::LPAREN) || !parseFunctionParams(stmt->parameters, stmt->paramTypes)) {
+            return nullptr;
+        }
+
+        if (peekTokenIs(TokenType::TERNARY)) {
+            nextToken();
+            nextToken();
+            stmt->returnType = parseType();
+        }
+
+        if (peekTokenIs(TokenType::SEMICOLON)) {
+            nextToken();
+        }
+        return stmt;
+    }
+
+    // expr; or target = value; where target is a name or an index
+    std::unique_ptr<Stmt> Parser::parseExprStmt() {
+        const std::size_t first = cur;
+        auto expr = parseExpr(static_cast<int>(Precedence::LOWEST));
+        if (!expr) {
+            return nullptr;
+        }
+
+        std::unique_ptr<Stmt> stmt;
+        if (peekTokenIs(TokenType::ASSIGN)) {
+            nextToken();
+            auto assign = std::make_unique<AssignStmt>();
+            assign->token = curToken();
+            assign->target = std::move(expr);
+            nextToken();
+            assign->value = parseExpr(static_cast<int>(Precedence::LOWEST));
+            if (!assign->value) {
+                return nullptr;
+            }
+            stmt = std::move(assign);
+        } else {
+            auto exprStmt = std::make_unique<ExprStmt>();
+            exprStmt->token = tokens.token(first);
+            exprStmt->expr = std::move(expr);
+            stmt = std::move(exprStmt);
+        }
+
+        if (peekTokenIs(TokenType::SEMICOLON)) {
+            nextToken();
+        }
+        return stmt;
+    }
+
+    std::unique_ptr<BlockStmt> Parser::parseBlockStmt() {
+        auto block = std::make_unique<BlockStmt>();
+        block->token = curToken();
+        nextToken();
+
+        while (!curTokenIs(TokenType::RBRACE) && !curTokenIs(TokenType::EoF)) {
+            if (auto stmt = parseStmt()) {
+                block->stmts.push_back(std::move(stmt));
+            }
+            nextToken();
+        }
+
+        if (!curTokenIs(TokenType::RBRACE)) {
+            errors.emplace_back("Parse error: unterminated block, expected RBRACE, line=" +
+                                std::to_string(block->token.line));
+        }
+        return block;
+    }
+
+    // num | bool | str | fnc | []type | {type: type} | ident
+    // cur is left on the last token of the type
+    std::string Parser::parseType() {
+        if (curTokenIs(TokenType::LBRACKET)) {
+            if (!expectPeek(TokenType::RBRACKET)) {
+                return "";
+            }
+            nextToken();
+            return "[]" + parseType();
+        }
+        if (curTokenIs(TokenType::LBRACE)) {
+            nextToken();
+            const std::string key = parseType();
+            if (!expectPeek(TokenType::COLON)) {
+                return "";
+            }
+            nextToken();
+            const std::string value = parseType();
+            if (!expectPeek(TokenType::RBRACE)) {
+                return "";
+            }
+            return "{" + key + ":" + value + "}";
+        }
+
+        // fnc(num, str) -> bool. the return type can't be left out, it would
+        // read as the arrow of a decl
+        if (curTokenIs(TokenType::FUNCTION) && peekTokenIs(TokenType::LPAREN)) {
+            nextToken();
+            std::string res = "fnc(";
+            while (!peekTokenIs(TokenType::RPAREN)) {
+                nextToken();
+                res += parseType();
+                if (!peekTokenIs(TokenType::COMMA)) {
+                    break;
+                }
+                nextToken();
+                res += ", ";
+            }
+            if (!expectPeek(TokenType::RPAREN) || !expectPeek(TokenType::TERNARY)) {
+                return "";
+            }
+            nextToken();
+            return res + ") -> " + parseType();
+        }
+
+        switch (kindAt(cur)) {
+            case TokenType::NUM_TYPE:
+            case TokenType::BOOL_TYPE:
+            case TokenType::STRING_TYPE:
+            case TokenType::FUNCTION:
+            case TokenType::IDENT:
+                return curLiteral();
+            default:
+                errors.emplace_back("Parse error: expected a type, got=" + tokenTypeToString(kindAt(cur)) +
+                                    ", line=" + std::to_string(lineAt(cur)));
+                return "";
+        }
+    }
+
+    // ---------- Expressions ---------
+    std::unique_ptr<Expr> Parser::parseExpr(const int precedence) {
+        const auto prefix = prefixParseFns.find(kindAt(cur));
+        if (prefix == prefixParseFns.end()) {
+            noPrefixParseFnError(kindAt(cur));
+            return nullptr;
+        }
+        std::unique_ptr<Expr> lhs = prefix->second();
+
+        while (lhs && !peekTokenIs(TokenType::SEMICOLON) && precedence < peekPrecedence()) {
+            const auto infix = infixParseFns.find(kindAt(cur + 1));
+            if (infix == infixParseFns.end()) {
+                return lhs;
+            }
+            nextToken();
+            lhs = infix->second(std::move(lhs));
+        }
+        return lhs;
+    }
+
+    std::unique_ptr<Identifier> Parser::parseIdentifier() {
+        return std::make_unique<Identifier>(curToken(), curLiteral());
+    }
+
+    // the value was decoded by the lexer, which reports literals that don't fit
+    std::unique_ptr<Expr> Parser::parseNumLiteral() {
+        return std::make_unique<NumLiteral>(curToken(), tokens.number(cur));
+    }
+
+    std::unique_ptr<Expr> Parser::parseStringLiteral() {
+        auto lit = std::make_unique<StringLiteral>();
+        lit->token = curToken();
+        lit->value = curLiteral();
+        return lit;
+    }
+
+    std::unique_ptr<Expr> Parser::parseBoolean() {
+        return std::make_unique<Boolean>(curToken(), curTokenIs(TokenType::TRUE));
+    }
+
+    std::unique_ptr<Expr> Parser::parsePrefixExpr() {
+        auto expr = std::make_unique<PrefixExpr>();
+        expr->token = curToken();
+        expr->op = curLiteral();
+        nextToken();
+        expr->right = parseExpr(static_cast<int>(Precedence::PREFIX));
+        if (!expr->right) {
+            return nullptr;
+        }
+        return expr;
+    }
+
+    std::unique_ptr<Expr> Parser::parseInfixExpr(std::unique_ptr<Expr> lhs) {
+        auto expr = std::make_unique<InfixExpr>();
+        expr->token = curToken();
+        expr->op = curLiteral();
+        expr->lhs = std::move(lhs);
+
+        const int precedence = currentPrecedence();
+        nextToken();
+        expr->rhs = parseExpr(precedence);
+        if (!expr->rhs) {
+            return nullptr;
+        }
+        return expr;
+    }
+
+    std::unique_ptr<Expr> Parser::parseGroupedExpr() {
+        nextToken();
+        auto expr = parseExpr(static_cast<int>(Precedence::LOWEST));
+        if (!expectPeek(TokenType::RPAREN)) {
+            return nullptr;
+        }
+        return expr;
+    }
+
+    // if cond { ... } else { ... }, the condition may be parenthesised
+    std::unique_ptr<Expr> Parser::parseIfExpr() {
+        auto expr = std::make_unique<IfExpr>();
+        expr->token = curToken();
+
+        nextToken();
+        expr->condition = parseExpr(static_cast<int>(Precedence::LOWEST));
+        if (!expr->condition || !expectPeek(TokenType::LBRACE)) {
+            return nullptr;
+        }
+        expr->consequence = parseBlockStmt();
+
+        if (peekTokenIs(TokenType::ELSE)) {
+            nextToken();
+            if (peekTokenIs(TokenType::IF)) {
+                // else if -> else { if ... }
+                nextToken();
+                auto block = std::make_unique<BlockStmt>();
+                block->token = curToken();
+                auto stmt = std::make_unique<ExprStmt>();
+                stmt->token = curToken();
+                stmt->expr = parseIfExpr();
+                if (!stmt->expr) {
+                    return nullptr;
+                }
+                block->stmts.push_back(std::move(stmt));
+                expr->alternative = std::move(block);
+            } else {
+                if (!expectPeek(TokenType::LBRACE)) {
+                    return nullptr;
+                }
+                expr->alternative = parseBlockStmt();
+            }
+        }
+        return expr;
+    }
+
+    // fnc name(a: num, b: num) -> num { ... }, name and types are optional
+    std::unique_ptr<Expr> Parser::parseFuncLiteral() {
+        auto func = parseFuncSignature();
+        if (!func || !expectPeek(TokenType::LBRACE)) {
+            return nullptr;
+        }
+        func->body = parseBlockStmt();
+        return func;
+    }
+
+    std::unique_ptr<FuncLiteral> Parser::parseFuncSignature() {
+        auto func = std::make_unique<FuncLiteral>();
+        func->token = curToken();
+
+        if (peekTokenIs(TokenType::IDENT)) {
+            nextToken();
+            func->name = curLiteral();
+        }
+
+        if (!expectPeek(TokenType::LPAREN) || !parseFunctionParams(func->parameters, func->paramTypes)) {
+            return nullptr;
+        }
+
+        if (peekTokenIs(TokenType::TERNARY)) {
+            nextToken();
+            nextToken();
+            func->returnType = parseType();
+        }
+        return func;
+    }
+
+    // async fnc name(...) {...}, a fnc lowered as a coroutine
+    std::unique_ptr<Expr> Parser::parseAsyncFuncLiteral() {
+        if (!expectPeek(TokenType::FUNCTION)) {
+            return nullptr;
+        }
+        auto func = parseFuncLiteral();
+        if (func) {
+            static_cast<FuncLiteral &>(*func).async = true;
+        }
+        return func;
+    }
+
+    bool Parser::parseFunctionParams(std::vector<std::unique_ptr<Identifier>> &params, std::vector<std::string> &types) {
+        if (peekTokenIs(TokenType::RPAREN)) {
+            nextToken();
+            return true;
+        }
+
+        while (true) {
+            if (!expectPeek(TokenType::IDENT)) {
+                return false;
+            }
+            params.push_back(parseIdentifier());
+
+            std::string type;
+            if (peekTokenIs(TokenType::COLON)) {
+                nextToken();
+                nextToken();
+                type = parseType();
+            }
+            types.push_back(type);
+
+            if (!peekTokenIs(TokenType::COMMA)) {
+                break;
+            }
+            nextToken();
+        }
+
+        return expectPeek(TokenType::RPAREN);
+    }
+
+    std::unique_ptr<Expr> Parser::parseFunctionCall(std::unique_ptr<Expr> function) {
+        auto call = std::make_unique<CallExpr>();
+        call->token = curToken();
+        call->function = std::move(function);
+        call->args = parseExprList(TokenType::RPAREN);
+        return call;
+    }
+
+    std::unique_ptr<Expr> Parser::parseArrayLiteral() {
+        auto array = std::make_unique<ArrayLiteral>();
+        array->token = curToken();
+        array->elements = parseExprList(TokenType::RBRACKET);
+        return array;
+    }
+
+    std::unique_ptr<Expr> Parser::parseIndexExpr(std::unique_ptr<Expr> left) {
+        auto expr = std::make_unique<IndexExpr>();
+        expr->token = curToken();
+        expr->left = std::move(left);
+
+        nextToken();
+        expr->index = parseExpr(static_cast<int>(Precedence::LOWEST));
+        if (!expr->index || !expectPeek(TokenType::RBRACKET)) {
+            return nullptr;
+        }
+        return expr;
+    }
+
+    // {key: value, ...}
+    std::unique_ptr<Expr> Parser::parseHashLiteral() {
+        auto hash = std::make_unique<HashLiteral>();
+        hash->token = curToken();
+
+        while (!peekTokenIs(TokenType::RBRACE)) {
+            nextToken();
+            auto key = parseExpr(static_cast<int>(Precedence::LOWEST));
+            if (!key || !expectPeek(TokenType::COLON)) {
+                return nullptr;
+            }
+            nextToken();
+            auto value = parseExpr(static_cast<int>(Precedence::LOWEST));
+            if (!value) {
+                return nullptr;
+            }
+            hash->pairs.emplace_back(std::move(key), std::move(value));
+
+            if (!peekTokenIs(TokenType::RBRACE) && !expectPeek(TokenType::COMMA)) {
+                return nullptr;
+            }
+        }
+
+        if (!expectPeek(TokenType::RBRACE)) {
+            return nullptr;
+        }
+        return hash;
+    }
+
+    std::vector<std::unique_ptr<Expr>> Parser::parseExprList(const TokenType end) {
+        std::vector<std::unique_ptr<Expr>> list;
+        if (peekTokenIs(end)) {
+            nextToken();
+            return list;
+        }
+
+        nextToken();
+        while (true) {
+            auto expr = parseExpr(static_cast<int>(Precedence::LOWEST));
+            if (!expr) {
+                return {};
+            }
+            list.push_back(std::move(expr));
+            if (!peekTokenIs(TokenType::COMMA)) {
+                break;
+            }
+            nextToken();
+            nextToken();
+        }
+
+        if (!expectPeek(end)) {
+            return {};
+        }
+        return list;
+    }
+} // cblt::parse
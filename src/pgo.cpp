@@ -0,0 +1,248 @@
+#include "h/pgo.h"
+#include "h/cobalt.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/ProfileData/InstrProf.h"
+#include "llvm/ProfileData/ProfileCommon.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <unordered_map>
+
+using namespace cblt::globals;
+
+namespace cblt::pgo {
+    enum struct Mode {
+        NONE,
+        GENERATE,
+        USE,
+    };
+
+    struct FunctionSites {
+        std::string name;
+        unsigned next = 0;
+        std::vector<std::uint64_t> counts; // entry first, used for the profile summary
+    };
+
+    static thread_local Mode mode = Mode::NONE;
+    static thread_local std::string outputPath;
+    static thread_local std::unordered_map<std::string, std::uint64_t> profile;
+    static thread_local std::vector<FunctionSites> functions; // innermost fnc being generated is last
+    static thread_local std::vector<std::pair<std::string, llvm::GlobalVariable *>> counters;
+    static thread_local std::vector<std::vector<std::uint64_t>> records;
+
+    void enableGenerate(const std::string &outPath) {
+        mode = Mode::GENERATE;
+        outputPath = outPath;
+        counters.clear();
+    }
+
+    // one "site count" pair per line, # starts a comment
+    bool enableUse(const std::string &path, std::string &err) {
+        std::ifstream in(path);
+        if (!in) {
+            err = "PGO error: could not read profile " + path;
+            return false;
+        }
+
+        profile.clear();
+        records.clear();
+        std::string line;
+        int lineNum = 0;
+        while (std::getline(in, line)) {
+            lineNum++;
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+            std::istringstream ss(line);
+            std::string site;
+            std::uint64_t count;
+            if (!(ss >> site >> count)) {
+                err = "PGO error: malformed profile line, line=" + std::to_string(lineNum) + ", file=" + path;
+                return false;
+            }
+            profile[site] += count;
+        }
+        mode = Mode::USE;
+        return true;
+    }
+
+    bool generating() {
+        return mode == Mode::GENERATE;
+    }
+
+    bool usingProfile() {
+        return mode == Mode::USE;
+    }
+
+    static std::string key(const std::string &site) {
+        return functions.back().name + ":" + site;
+    }
+
+    static std::optional<std::uint64_t> lookup(const std::string &site) {
+        const auto it = profile.find(key(site));
+        if (it == profile.end()) {
+            return std::nullopt;
+        }
+        functions.back().counts.push_back(it->second);
+        return it->second;
+    }
+
+    // branch weights are 32 bit, keep the ratio when counts overflow that. no
+    // +1 smoothing like llvm's own pgo, on a loop entered once it halves the
+    // trip count and the body stops looking hot
+    static std::uint32_t scaleWeight(const std::uint64_t count, const std::uint64_t scale) {
+        return static_cast<std::uint32_t>(count / scale);
+    }
+
+    void enterFunction(llvm::Function *fn) {
+        functions.push_back({fn->getName().str(), 0, {}});
+        if (mode == Mode::GENERATE) {
+            counter("entry");
+        } else if (mode == Mode::USE) {
+            if (const auto count = lookup("entry")) {
+                fn->setEntryCount(llvm::Function::ProfileCount(*count, llvm::Function::PCT_Real));
+            }
+        }
+    }
+
+    void leaveFunction() {
+        if (mode == Mode::USE && !functions.back().counts.empty()) {
+            records.push_back(std::move(functions.back().counts));
+        }
+        functions.pop_back();
+    }
+
+    std::string nextSite(const std::string &kind) {
+        return kind + std::to_string(functions.back().next++);
+    }
+
+    void counter(const std::string &site) {
+        if (mode != Mode::GENERATE) {
+            return;
+        }
+        llvm::Type *i64 = Builder->getInt64Ty();
+        auto *gv = new llvm::GlobalVariable(*Module, i64, false, llvm::GlobalValue::PrivateLinkage,
+                                            llvm::ConstantInt::get(i64, 0), "__cblt_prof." + key(site));
+        counters.emplace_back(key(site), gv);
+
+        llvm::Value *count = Builder->CreateLoad(i64, gv, "prof.count");
+        Builder->CreateStore(Builder->CreateAdd(count, llvm::ConstantInt::get(i64, 1)), gv);
+    }
+
+    void weighBranch(llvm::BranchInst *br, const std::string &taken, const std::string &total) {
+        if (mode != Mode::USE) {
+            return;
+        }
+        const auto takenCount = lookup(taken);
+        const auto totalCount = lookup(total);
+        if (!takenCount || !totalCount) {
+            return;
+        }
+        const std::uint64_t notTaken = *totalCount > *takenCount ? *totalCount - *takenCount : 0;
+        if (*takenCount == 0 && notTaken == 0) {
+            return;
+        }
+        const std::uint64_t scale = std::max(*takenCount, notTaken) / UINT32_MAX + 1;
+
+        llvm::MDBuilder md(Context);
+        br->setMetadata(llvm::LLVMContext::MD_prof,
+                        md.createBranchWeights(scaleWeight(*takenCount, scale), scaleWeight(notTaken, scale)));
+    }
+
+    void weighLoop(llvm::BranchInst *latch, const std::string &body, const std::string &entered) {
+        if (mode != Mode::USE) {
+            return;
+        }
+        const auto bodyCount = lookup(body);
+        const auto enteredCount = lookup(entered);
+        if (!bodyCount || !enteredCount) {
+            return;
+        }
+        const std::uint64_t back = *bodyCount > *enteredCount ? *bodyCount - *enteredCount : 0;
+        if (back == 0 && *enteredCount == 0) {
+            return;
+        }
+        const std::uint64_t scale = std::max(back, *enteredCount) / UINT32_MAX + 1;
+
+        llvm::MDBuilder md(Context);
+        latch->setMetadata(llvm::LLVMContext::MD_prof,
+                           md.createBranchWeights(scaleWeight(back, scale), scaleWeight(*enteredCount, scale)));
+    }
+
+    void weighCall(llvm::CallInst *call, const std::string &site) {
+        if (mode != Mode::USE) {
+            return;
+        }
+        if (const auto count = lookup(site)) {
+            llvm::MDBuilder md(Context);
+            const std::uint32_t weight = static_cast<std::uint32_t>(std::min<std::uint64_t>(*count, UINT32_MAX));
+            call->setMetadata(llvm::LLVMContext::MD_prof, md.createBranchWeights({weight}));
+        }
+    }
+
+    // __cblt_prof_register(counters, names, n, path) from a global ctor,
+    // the runtime dumps and merges everything registered at exit
+    static void emitRegistration(llvm::Module &module) {
+        if (counters.empty()) {
+            return;
+        }
+        llvm::LLVMContext &ctx = module.getContext();
+        llvm::Type *i64 = llvm::Type::getInt64Ty(ctx);
+        llvm::PointerType *i64Ptr = llvm::PointerType::getUnqual(i64);
+        llvm::PointerType *i8Ptr = llvm::Type::getInt8PtrTy(ctx);
+
+        llvm::Function *init = llvm::Function::Create(llvm::FunctionType::get(llvm::Type::getVoidTy(ctx), false),
+                                                      llvm::GlobalValue::InternalLinkage, "__cblt_prof_init", module);
+        llvm::IRBuilder<> b(llvm::BasicBlock::Create(ctx, "entry", init));
+
+        std::vector<llvm::Constant *> counterPtrs, names;
+        for (const auto &[name, gv]: counters) {
+            counterPtrs.push_back(gv);
+            names.push_back(b.CreateGlobalStringPtr(name, "__cblt_prof.name"));
+        }
+
+        auto *countersTy = llvm::ArrayType::get(i64Ptr, counterPtrs.size());
+        auto *countersGv = new llvm::GlobalVariable(module, countersTy, true, llvm::GlobalValue::PrivateLinkage,
+                                                    llvm::ConstantArray::get(countersTy, counterPtrs),
+                                                    "__cblt_prof.counters");
+        auto *namesTy = llvm::ArrayType::get(i8Ptr, names.size());
+        auto *namesGv = new llvm::GlobalVariable(module, namesTy, true, llvm::GlobalValue::PrivateLinkage,
+                                                 llvm::ConstantArray::get(namesTy, names), "__cblt_prof.names");
+
+        const llvm::FunctionCallee reg = module.getOrInsertFunction(
+            "__cblt_prof_register",
+            llvm::FunctionType::get(b.getVoidTy(), {llvm::PointerType::getUnqual(i64Ptr),
+                                                    llvm::PointerType::getUnqual(i8Ptr), i64, i8Ptr}, false));
+        b.CreateCall(reg, {
+                         b.CreateConstInBoundsGEP2_32(countersTy, countersGv, 0, 0),
+                         b.CreateConstInBoundsGEP2_32(namesTy, namesGv, 0, 0),
+                         b.getInt64(counterPtrs.size()),
+                         b.CreateGlobalStringPtr(outputPath, "__cblt_prof.path"),
+                     });
+        b.CreateRetVoid();
+        llvm::appendToGlobalCtors(module, init, 0);
+        counters.clear();
+    }
+
+    // without a summary the optimizer can't tell hot from cold, only relative weights
+    static void emitSummary(llvm::Module &module) {
+        if (records.empty()) {
+            return;
+        }
+        llvm::InstrProfSummaryBuilder builder(llvm::ProfileSummaryBuilder::DefaultCutoffs);
+        for (auto &counts: records) {
+            builder.addRecord(llvm::InstrProfRecord(std::move(counts)));
+        }
+        module.setProfileSummary(builder.getSummary()->getMD(module.getContext()), llvm::ProfileSummary::PSK_Instr);
+        records.clear();
+    }
+
+    void finishModule(llvm::Module &module) {
+        if (mode == Mode::GENERATE) {
+            emitRegistration(module);
+        } else if (mode == Mode::USE) {
+            emitSummary(module);
+        }
+    }
+} // cblt::pgo
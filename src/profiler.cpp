@@ -0,0 +1,108 @@
+#include "h/profiler.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+
+namespace cblt::profiler {
+    static thread_local bool on = false;
+    static thread_local std::string outputPath;
+
+    void enable(const std::string &outPath) {
+        on = true;
+        outputPath = outPath;
+    }
+
+    bool enabled() {
+        return on;
+    }
+
+    // below this many instructions a loop free fnc runs in a few nanoseconds,
+    // less than the hooks themselves cost, so it is timed as part of its caller
+    // like an inlined one. the same rule xray uses, the profile header in
+    // runtime/fnprof.cpp states it
+    constexpr unsigned MIN_INSTRUCTIONS = 64;
+
+    // runtime entry points, ctors and closure thunks aren't cobalt fncs
+    static bool instrumentable(llvm::Function &fn) {
+        if (fn.isDeclaration() || fn.getName().startswith("__cblt") || fn.getName().endswith(".closure")) {
+            return false;
+        }
+        // a coroutine's rets are suspends as often as exits
+        if (fn.hasFnAttribute("cblt.async")) {
+            return false;
+        }
+        if (fn.getName() == "main" || fn.getInstructionCount() >= MIN_INSTRUCTIONS) {
+            return true;
+        }
+        const llvm::DominatorTree dt(fn);
+        const llvm::LoopInfo loops(dt);
+        return !loops.empty();
+    }
+
+    // the exit hook goes in front of a tail call feeding the ret, so the call
+    // stays in tail position and the callee shows up as a sibling
+    static void instrumentExits(llvm::Function &fn, const llvm::FunctionCallee exitHook, llvm::Value *id) {
+        for (llvm::BasicBlock &bb: fn) {
+            auto *ret = llvm::dyn_cast_or_null<llvm::ReturnInst>(bb.getTerminator());
+            if (!ret) {
+                continue;
+            }
+            llvm::Instruction *at = ret;
+            if (auto *call = llvm::dyn_cast_or_null<llvm::CallInst>(ret->getPrevNode()); call && call->isTailCall()) {
+                at = call;
+            }
+            llvm::CallInst::Create(exitHook, {id}, "", at);
+        }
+    }
+
+    void instrument(llvm::Module &module) {
+        if (!on) {
+            return;
+        }
+        llvm::LLVMContext &ctx = module.getContext();
+        llvm::Type *i32 = llvm::Type::getInt32Ty(ctx);
+        llvm::PointerType *i8Ptr = llvm::Type::getInt8PtrTy(ctx);
+        llvm::FunctionType *hookType = llvm::FunctionType::get(llvm::Type::getVoidTy(ctx), {i32}, false);
+        const llvm::FunctionCallee enterHook = module.getOrInsertFunction("__cblt_fnprof_enter", hookType);
+        const llvm::FunctionCallee exitHook = module.getOrInsertFunction("__cblt_fnprof_exit", hookType);
+
+        std::vector<llvm::Function *> fncs;
+        for (llvm::Function &fn: module) {
+            if (instrumentable(fn)) {
+                fncs.push_back(&fn);
+            }
+        }
+        if (fncs.empty()) {
+            return;
+        }
+
+        llvm::Function *init = llvm::Function::Create(llvm::FunctionType::get(llvm::Type::getVoidTy(ctx), false),
+                                                      llvm::GlobalValue::InternalLinkage, "__cblt_fnprof_init", module);
+        llvm::IRBuilder<> b(llvm::BasicBlock::Create(ctx, "entry", init));
+
+        std::vector<llvm::Constant *> names;
+        for (llvm::Function *fn: fncs) {
+            llvm::Constant *id = llvm::ConstantInt::get(i32, names.size());
+            names.push_back(b.CreateGlobalStringPtr(fn->getName(), "__cblt_fnprof.name"));
+            llvm::BasicBlock &entry = fn->getEntryBlock();
+            llvm::CallInst::Create(enterHook, {id}, "", &*entry.getFirstInsertionPt());
+            instrumentExits(*fn, exitHook, id);
+        }
+
+        auto *namesTy = llvm::ArrayType::get(i8Ptr, names.size());
+        auto *namesGv = new llvm::GlobalVariable(module, namesTy, true, llvm::GlobalValue::PrivateLinkage,
+                                                 llvm::ConstantArray::get(namesTy, names), "__cblt_fnprof.names");
+        const llvm::FunctionCallee reg = module.getOrInsertFunction(
+            "__cblt_fnprof_register",
+            llvm::FunctionType::get(b.getVoidTy(), {llvm::PointerType::getUnqual(i8Ptr), i32, i8Ptr}, false));
+        b.CreateCall(reg, {
+                         b.CreateConstInBoundsGEP2_32(namesTy, namesGv, 0, 0),
+                         b.getInt32(names.size()),
+                         b.CreateGlobalStringPtr(outputPath, "__cblt_fnprof.path"),
+                     });
+        b.CreateRetVoid();
+        llvm::appendToGlobalCtors(module, init, 0);
+    }
+} // cblt::profiler
@@ -0,0 +1,282 @@
+// runtime half of --profile, linked into programs built with it. the compiler
+// calls __cblt_fnprof_enter / __cblt_fnprof_exit around every fnc that is
+// still out of line after optimization. each thread appends timestamped
+// events to its own buffer and only folds them into its call tree when the
+// buffer fills, so the hooks themselves are a counter read and two stores.
+// at exit the trees are merged into a per fnc table and folded stacks. other
+// threads may still be recording then, so each publishes how far its buffer
+// is written and its tree is only touched under its lock
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace {
+    constexpr std::size_t BUFFER_EVENTS = 1 << 16;
+    constexpr std::uint32_t EXIT_BIT = 1u << 31;
+
+    std::uint64_t ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+    }
+
+    struct Event {
+        std::uint64_t tsc;
+        std::uint32_t id; // EXIT_BIT set on exits
+    };
+
+    // one per distinct call path, children are found through ThreadProfile::edges
+    struct PathNode {
+        std::uint32_t id;
+        std::uint32_t parent;
+        std::uint32_t lastId = EXIT_BIT; // last child looked up, recursion and loops hit it
+        std::uint32_t lastChild = 0;
+        std::uint64_t calls = 0;
+        std::uint64_t exclusive = 0;
+    };
+
+    struct Frame {
+        std::uint32_t node;
+        std::uint64_t start;
+        std::uint64_t children = 0; // ticks spent in callees
+    };
+
+    struct FncTotals {
+        std::uint64_t calls = 0;
+        std::uint64_t inclusive = 0; // outermost activation only, recursion isn't counted twice
+        std::uint64_t exclusive = 0;
+    };
+
+    constexpr std::uint32_t ROOT = 0;
+
+    struct ThreadProfile {
+        Event events[BUFFER_EVENTS];
+        std::atomic<std::uint32_t> published{0}; // events written so far, set by the owner
+        std::mutex lock; // the fields below, the owner only takes it when its buffer fills
+        std::uint32_t replayed = 0; // events already folded in
+        std::vector<PathNode> nodes{PathNode{0, 0}};
+        std::unordered_map<std::uint64_t, std::uint32_t> edges; // parent << 32 | id -> child
+        std::vector<Frame> stack;
+        std::vector<FncTotals> totals; // by fnc id
+        std::vector<std::uint32_t> active; // activations on the stack by fnc id
+
+        explicit ThreadProfile(const std::uint32_t fncCount) : totals(fncCount), active(fncCount) {
+            stack.reserve(1024);
+        }
+
+        std::uint32_t child(const std::uint32_t parent, const std::uint32_t id) {
+            if (nodes[parent].lastId == id) {
+                return nodes[parent].lastChild;
+            }
+            const auto [it, fresh] = edges.try_emplace(static_cast<std::uint64_t>(parent) << 32 | id,
+                                                       static_cast<std::uint32_t>(nodes.size()));
+            if (fresh) {
+                nodes.push_back({id, parent});
+            }
+            nodes[parent].lastId = id;
+            nodes[parent].lastChild = it->second;
+            return it->second;
+        }
+
+        void enter(const std::uint32_t id, const std::uint64_t tsc) {
+            const std::uint32_t parent = stack.empty() ? ROOT : stack.back().node;
+            stack.push_back({child(parent, id), tsc});
+            active[id]++;
+        }
+
+        void exit(const std::uint64_t tsc) {
+            if (stack.empty()) {
+                return;
+            }
+            const Frame frame = stack.back();
+            stack.pop_back();
+            const std::uint64_t inclusive = tsc - frame.start;
+            const std::uint64_t exclusive = inclusive > frame.children ? inclusive - frame.children : 0;
+
+            PathNode &node = nodes[frame.node];
+            node.calls++;
+            node.exclusive += exclusive;
+            FncTotals &fnc = totals[node.id];
+            fnc.calls++;
+            fnc.exclusive += exclusive;
+            if (--active[node.id] == 0) {
+                fnc.inclusive += inclusive;
+            }
+            if (!stack.empty()) {
+                stack.back().children += inclusive;
+            }
+        }
+
+        // folds in what's been published since the last replay, lock held
+        void replay() {
+            const std::uint32_t end = published.load(std::memory_order_acquire);
+            for (; replayed < end; replayed++) {
+                const Event &e = events[replayed];
+                if (e.id & EXIT_BIT) {
+                    exit(e.tsc);
+                } else {
+                    enter(e.id, e.tsc);
+                }
+            }
+        }
+    };
+
+    // trivially destructible so the hooks skip the tls init guard
+    struct ThreadBuffer {
+        Event *next;
+        Event *end;
+        ThreadProfile *profile;
+    };
+
+    thread_local ThreadBuffer buffer;
+
+    struct Registration {
+        const char **names = nullptr;
+        std::uint32_t n = 0;
+        std::string path;
+        std::uint64_t startTsc = 0;
+        std::chrono::steady_clock::time_point start;
+        std::mutex lock;
+        std::vector<ThreadProfile *> threads; // every thread that recorded, never freed
+    };
+
+    Registration &registration() {
+        static Registration reg;
+        return reg;
+    }
+
+    [[gnu::noinline]] void refill() {
+        ThreadBuffer &buf = buffer;
+        if (!buf.profile) {
+            Registration &reg = registration();
+            buf.profile = new ThreadProfile(reg.n);
+            std::lock_guard guard(reg.lock);
+            reg.threads.push_back(buf.profile);
+        } else {
+            std::lock_guard guard(buf.profile->lock);
+            buf.profile->replay();
+            buf.profile->replayed = 0;
+            buf.profile->published.store(0, std::memory_order_relaxed);
+        }
+        buf.next = buf.profile->events;
+        buf.end = buf.profile->events + BUFFER_EVENTS;
+    }
+
+    void record(const std::uint32_t id) {
+        if (buffer.next == buffer.end) {
+            refill();
+        }
+        Event *e = buffer.next++;
+        e->id = id;
+        e->tsc = ticks();
+        buffer.profile->published.store(static_cast<std::uint32_t>(buffer.next - buffer.profile->events),
+                                        std::memory_order_release);
+    }
+
+    std::string fncName(const std::uint32_t id) {
+        const Registration &reg = registration();
+        return id < reg.n ? reg.names[id] : "?";
+    }
+
+    void dump() {
+        Registration &reg = registration();
+        const std::uint64_t endTsc = ticks();
+        const double elapsedNs = std::chrono::duration<double, std::nano>(
+            std::chrono::steady_clock::now() - reg.start).count();
+        const double nsPerTick = endTsc > reg.startTsc ? elapsedNs / static_cast<double>(endTsc - reg.startTsc) : 1;
+        const auto ns = [&](const std::uint64_t t) {
+            return static_cast<std::uint64_t>(static_cast<double>(t) * nsPerTick);
+        };
+
+        std::vector<FncTotals> totals(reg.n);
+        std::map<std::string, std::uint64_t> folded;
+        std::lock_guard guard(reg.lock);
+        for (ThreadProfile *thread: reg.threads) {
+            ThreadProfile &profile = *thread;
+            std::lock_guard threadGuard(profile.lock);
+            profile.replay();
+            // fncs still running, e.g. when exit() was called from inside one
+            // or on a thread that hasn't finished
+            while (!profile.stack.empty()) {
+                profile.exit(endTsc);
+            }
+
+            for (std::uint32_t id = 0; id < totals.size(); id++) {
+                totals[id].calls += profile.totals[id].calls;
+                totals[id].inclusive += profile.totals[id].inclusive;
+                totals[id].exclusive += profile.totals[id].exclusive;
+            }
+            for (std::uint32_t i = 1; i < profile.nodes.size(); i++) {
+                std::string stack = fncName(profile.nodes[i].id);
+                for (std::uint32_t p = profile.nodes[i].parent; p != ROOT; p = profile.nodes[p].parent) {
+                    stack.insert(0, fncName(profile.nodes[p].id) + ";");
+                }
+                folded[stack] += ns(profile.nodes[i].exclusive);
+            }
+        }
+
+        std::ofstream out(reg.path, std::ios::trunc);
+        if (!out) {
+            std::fprintf(stderr, "cobalt: could not write profile %s\n", reg.path.c_str());
+            return;
+        }
+        std::vector<std::uint32_t> order;
+        for (std::uint32_t id = 0; id < totals.size(); id++) {
+            if (totals[id].calls) {
+                order.push_back(id);
+            }
+        }
+        std::sort(order.begin(), order.end(), [&](const std::uint32_t a, const std::uint32_t b) {
+            return totals[a].exclusive > totals[b].exclusive;
+        });
+        // the rule for small fncs is MIN_INSTRUCTIONS in profiler.cpp
+        out << "# cobalt fnc profile, times in microseconds. fncs inlined by the optimizer, loop free fncs under\n"
+               "# 64 instructions and async fncs aren't timed or counted, their time goes to the caller\n";
+        out << "# calls inclusive exclusive fnc\n";
+        for (const std::uint32_t id: order) {
+            out << totals[id].calls << ' ' << ns(totals[id].inclusive) / 1000 << ' '
+                << ns(totals[id].exclusive) / 1000 << ' ' << fncName(id) << '\n';
+        }
+
+        // stack;frames nanoseconds, what flamegraph.pl and speedscope read
+        std::ofstream stacks(reg.path + ".folded", std::ios::trunc);
+        for (const auto &[stack, time]: folded) {
+            if (time) {
+                stacks << stack << ' ' << time << '\n';
+            }
+        }
+    }
+}
+
+// one call from a global ctor, names are indexed by the ids the hooks pass
+extern "C" void __cblt_fnprof_register(const char **names, const std::uint32_t n, const char *path) {
+    Registration &reg = registration();
+    reg.names = names;
+    reg.n = n;
+    reg.path = path;
+    reg.start = std::chrono::steady_clock::now();
+    reg.startTsc = ticks();
+    std::atexit(dump);
+}
+
+extern "C" void __cblt_fnprof_enter(const std::uint32_t id) {
+    record(id);
+}
+
+extern "C" void __cblt_fnprof_exit(const std::uint32_t id) {
+    record(id | EXIT_BIT);
+}
@@ -0,0 +1,209 @@
+// runtime heap for str, []num and closure environments, linked into compiled
+// cobalt programs. values that can outlive the fnc that made them are bump
+// allocated from thread-local slabs and never freed, nothing tracks when the
+// last reference to one goes away, so a loop that keeps building escaping
+// values grows until exit. everything else is bump allocated in the region of
+// the invocation that made it and released wholesale when it exits.
+// CBLT_HEAP_STATS=1 in the environment prints allocation counts at exit
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+    constexpr std::size_t ALIGN = 16;
+    constexpr std::size_t MAX_SMALL = 1024; // pool objects, bigger goes straight to malloc
+    constexpr std::size_t SLAB_SIZE = 64 * 1024;
+    constexpr std::size_t CHUNK_SIZE = 64 * 1024;
+    constexpr std::size_t MAX_IN_CHUNK = CHUNK_SIZE / 4; // bigger region allocations get their own chunk
+
+    // region memory, chained newest first. data starts right after the header
+    struct alignas(ALIGN) Chunk {
+        Chunk *prev;
+        char *end;
+    };
+
+    char *chunkData(Chunk *chunk) {
+        return reinterpret_cast<char *>(chunk + 1);
+    }
+
+    // trivially destructible so the fast paths skip the tls init guard
+    struct ThreadHeap {
+        char *slab; // pool objects are carved from here
+        char *slabEnd;
+        Chunk *chunk; // current region chunk
+        char *top; // region bump pointer, marks are saved tops
+        char *limit;
+        Chunk *spare; // one released chunk, saves a malloc per region that spills
+    };
+
+    thread_local ThreadHeap heap;
+
+    struct Stats {
+        std::atomic<std::uint64_t> poolAllocs, poolBytes;
+        std::atomic<std::uint64_t> largeAllocs, largeBytes;
+        std::atomic<std::uint64_t> regionAllocs, regionBytes, regionExits;
+        std::atomic<std::uint64_t> chunks;
+    };
+
+    Stats stats;
+    bool statsEnabled = false;
+
+    void count(std::atomic<std::uint64_t> &allocs, std::atomic<std::uint64_t> &bytes, const std::uint64_t size) {
+        allocs.fetch_add(1, std::memory_order_relaxed);
+        bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+
+    void printStats() {
+        std::fprintf(stderr,
+                     "cobalt heap: pool %llu allocs %llu bytes, large %llu allocs %llu bytes, "
+                     "region %llu allocs %llu bytes %llu exits %llu chunks\n",
+                     static_cast<unsigned long long>(stats.poolAllocs.load()),
+                     static_cast<unsigned long long>(stats.poolBytes.load()),
+                     static_cast<unsigned long long>(stats.largeAllocs.load()),
+                     static_cast<unsigned long long>(stats.largeBytes.load()),
+                     static_cast<unsigned long long>(stats.regionAllocs.load()),
+                     static_cast<unsigned long long>(stats.regionBytes.load()),
+                     static_cast<unsigned long long>(stats.regionExits.load()),
+                     static_cast<unsigned long long>(stats.chunks.load()));
+    }
+
+    [[maybe_unused]] const bool statsInit = [] {
+        const char *env = std::getenv("CBLT_HEAP_STATS");
+        if (env && *env && std::strcmp(env, "0") != 0) {
+            statsEnabled = true;
+            std::atexit(printStats);
+        }
+        return true;
+    }();
+
+    [[noreturn]] void outOfMemory(const std::uint64_t size) {
+        std::fprintf(stderr, "cobalt: out of memory allocating %llu bytes\n", static_cast<unsigned long long>(size));
+        std::abort();
+    }
+
+    std::size_t roundUp(const std::uint64_t size) {
+        return size ? (size + ALIGN - 1) & ~(ALIGN - 1) : ALIGN;
+    }
+
+    // slabs outlive their thread, a value may still be live in another
+    // thread when the one that made it exits
+    void *carve(const std::size_t size) {
+        if (static_cast<std::size_t>(heap.slabEnd - heap.slab) < size) {
+            heap.slab = static_cast<char *>(std::aligned_alloc(ALIGN, SLAB_SIZE));
+            if (!heap.slab) {
+                outOfMemory(SLAB_SIZE);
+            }
+            heap.slabEnd = heap.slab + SLAB_SIZE;
+        }
+        void *ptr = heap.slab;
+        heap.slab += size;
+        return ptr;
+    }
+
+    void releaseChunk(Chunk *chunk) {
+        if (!heap.spare && chunk->end - chunkData(chunk) == CHUNK_SIZE) {
+            heap.spare = chunk;
+        } else {
+            std::free(chunk);
+        }
+    }
+
+    // region chunks are only reachable from their thread, so they go with it
+    struct ChunkReleaser {
+        ~ChunkReleaser() {
+            while (Chunk *chunk = heap.chunk) {
+                heap.chunk = chunk->prev;
+                std::free(chunk);
+            }
+            std::free(heap.spare);
+            heap.spare = nullptr;
+            heap.top = heap.limit = nullptr;
+        }
+    };
+
+    // kept out of line so the bump path in __cblt_region_alloc stays a leaf
+    [[gnu::noinline]] void *regionSlow(const std::size_t size) {
+        thread_local ChunkReleaser releaser;
+        (void) releaser;
+
+        const std::size_t dataSize = size > MAX_IN_CHUNK ? size : CHUNK_SIZE;
+        Chunk *chunk;
+        if (dataSize == CHUNK_SIZE && heap.spare) {
+            chunk = heap.spare;
+            heap.spare = nullptr;
+        } else {
+            chunk = static_cast<Chunk *>(std::aligned_alloc(ALIGN, sizeof(Chunk) + dataSize));
+            if (!chunk) {
+                outOfMemory(dataSize);
+            }
+            chunk->end = chunkData(chunk) + dataSize;
+            if (statsEnabled) {
+                stats.chunks.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        chunk->prev = heap.chunk;
+        heap.chunk = chunk;
+        heap.top = chunkData(chunk) + size;
+        heap.limit = chunk->end;
+        return chunkData(chunk);
+    }
+}
+
+extern "C" void *__cblt_alloc(const std::uint64_t size) {
+    if (size > MAX_SMALL) {
+        if (statsEnabled) {
+            count(stats.largeAllocs, stats.largeBytes, size);
+        }
+        void *ptr = std::aligned_alloc(ALIGN, roundUp(size));
+        if (!ptr) {
+            outOfMemory(size);
+        }
+        return ptr;
+    }
+
+    const std::size_t rounded = roundUp(size);
+    if (statsEnabled) {
+        count(stats.poolAllocs, stats.poolBytes, rounded);
+    }
+    return carve(rounded);
+}
+
+// the mark is the bump pointer, exiting a region drops everything above it
+extern "C" void *__cblt_region_enter() {
+    return heap.top;
+}
+
+extern "C" void __cblt_region_exit(void *mark) {
+    char *top = static_cast<char *>(mark);
+    while (heap.chunk && (top < chunkData(heap.chunk) || top > heap.chunk->end)) {
+        Chunk *chunk = heap.chunk;
+        heap.chunk = chunk->prev;
+        releaseChunk(chunk);
+    }
+    heap.top = top;
+    heap.limit = heap.chunk ? heap.chunk->end : nullptr;
+    if (statsEnabled) {
+        stats.regionExits.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+extern "C" void *__cblt_region_alloc(const std::uint64_t size) {
+    const std::size_t rounded = roundUp(size);
+    if (statsEnabled) {
+        count(stats.regionAllocs, stats.regionBytes, rounded);
+    }
+    if (rounded <= static_cast<std::size_t>(heap.limit - heap.top)) {
+        void *ptr = heap.top;
+        heap.top += rounded;
+        return ptr;
+    }
+    return regionSlow(rounded);
+}
+
+extern "C" [[noreturn]] void __cblt_index_oob(const std::int64_t index, const std::int64_t length) {
+    std::fprintf(stderr, "cobalt: index %lld out of range for length %lld\n", static_cast<long long>(index),
+                 static_cast<long long>(length));
+    std::abort();
+}
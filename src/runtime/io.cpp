@@ -0,0 +1,438 @@
+// file io builtins, linked into compiled cobalt programs. readFile maps the
+// file and hands back a str pointing into the mapping, which stays until
+// the program exits, so reading it and taking slices of it copy nothing.
+// lineEnd and parseColumn find newlines 64 bytes at a time with sse2, and
+// parseColumn splits big inputs across threads. writers buffer their output
+// and are flushed at close or at exit
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+    // cblt.str and cblt.array
+    struct Str {
+        const char *data;
+        std::int64_t len;
+    };
+
+    struct Array {
+        double *data;
+        std::int64_t len;
+    };
+
+    [[noreturn]] void fail(const std::string &msg) {
+        std::fprintf(stderr, "cobalt: %s\n", msg.c_str());
+        std::abort();
+    }
+
+    std::string pathOf(const char *path, const std::int64_t len) {
+        return {path, static_cast<std::size_t>(len)};
+    }
+
+#ifdef __SSE2__
+    // bit i set when p[i] is a newline, p 16 byte aligned
+    unsigned newlines16(const char *p) {
+        const __m128i nl = _mm_set1_epi8('\n');
+        return static_cast<unsigned>(_mm_movemask_epi8(
+            _mm_cmpeq_epi8(_mm_load_si128(reinterpret_cast<const __m128i *>(p)), nl)));
+    }
+
+    std::uint64_t newlines64(const char *p) {
+        return newlines16(p) | static_cast<std::uint64_t>(newlines16(p + 16)) << 16 |
+               static_cast<std::uint64_t>(newlines16(p + 32)) << 32 |
+               static_cast<std::uint64_t>(newlines16(p + 48)) << 48;
+    }
+#endif
+
+    // the first newline in [p, end), or end. loads are aligned and never
+    // cross into a page the str doesn't reach, which a mapped file needs
+    const char *findNewline(const char *p, const char *end) {
+#ifdef __SSE2__
+        if (p >= end) {
+            return end;
+        }
+        const auto at = reinterpret_cast<std::uintptr_t>(p);
+        const char *block = reinterpret_cast<const char *>(at & ~std::uintptr_t{15});
+        unsigned head = newlines16(block) >> (at & 15);
+        if (head) {
+            return std::min(p + __builtin_ctz(head), end);
+        }
+        block += 16;
+        while (reinterpret_cast<std::uintptr_t>(block) & 63) {
+            if (block >= end) {
+                return end;
+            }
+            if (const unsigned m = newlines16(block)) {
+                return std::min(block + __builtin_ctz(m), end);
+            }
+            block += 16;
+        }
+        for (; block < end; block += 64) {
+            if (const std::uint64_t m = newlines64(block)) {
+                return std::min(block + __builtin_ctzll(m), end);
+            }
+        }
+        return end;
+#else
+        const void *nl = std::memchr(p, '\n', end - p);
+        return nl ? static_cast<const char *>(nl) : end;
+#endif
+    }
+
+    // [-]digits[.digits] with at most 15 digits filling [p, end), the usual
+    // csv num. the digits fit a double exactly and so does the power of ten,
+    // so one divide rounds correctly. false for anything else, from_chars does it
+    bool parseDecimal(const char *p, const char *end, double &value) {
+        static constexpr double powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7,
+                                            1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15};
+        const bool negative = p < end && *p == '-';
+        p += negative;
+        std::uint64_t digits = 0;
+        int count = 0;
+        int fraction = -1;
+        for (; p < end; p++) {
+            if (*p >= '0' && *p <= '9') {
+                digits = digits * 10 + (*p - '0');
+                count++;
+                fraction += fraction >= 0;
+            } else if (*p == '.' && fraction < 0) {
+                fraction = 0;
+            } else {
+                break;
+            }
+        }
+        if (count == 0 || count > 15 || p < end) {
+            return false;
+        }
+        value = static_cast<double>(digits) / powers[std::max(fraction, 0)];
+        value = negative ? -value : value;
+        return true;
+    }
+
+    // the column-th field of [line, end), NaN when it's missing or isn't a
+    // num with nothing but spaces and tabs around it
+    double parseField(const char *line, const char *end, std::int64_t column, const char sep) {
+        const char *p = line;
+        for (; column > 0; column--) {
+            const void *next = std::memchr(p, sep, end - p);
+            if (!next) {
+                return NAN;
+            }
+            p = static_cast<const char *>(next) + 1;
+        }
+        const void *next = std::memchr(p, sep, end - p);
+        const char *fieldEnd = next ? static_cast<const char *>(next) : end;
+        while (p < fieldEnd && (*p == ' ' || *p == '\t')) {
+            p++;
+        }
+        while (fieldEnd > p && (fieldEnd[-1] == ' ' || fieldEnd[-1] == '\t')) {
+            fieldEnd--;
+        }
+        if (p < fieldEnd && *p == '+') {
+            p++;
+        }
+        double value;
+        if (parseDecimal(p, fieldEnd, value)) {
+            return value;
+        }
+        const auto [rest, ec] = std::from_chars(p, fieldEnd, value);
+        return ec == std::errc() && rest == fieldEnd && rest != p ? value : NAN;
+    }
+
+    // parsed values, grown with realloc so a big column is remapped rather
+    // than copied, and handed to the program as is
+    struct Column {
+        double *data = nullptr;
+        std::size_t len = 0;
+        std::size_t cap = 0;
+
+        void push(const double value) {
+            if (len == cap) {
+                cap = std::max<std::size_t>(cap * 2, 1024);
+                data = static_cast<double *>(std::realloc(data, cap * sizeof(double)));
+                if (!data) {
+                    fail("out of memory for parseColumn");
+                }
+            }
+            data[len++] = value;
+        }
+    };
+
+    // one value per non empty line of [p, end), end at a line boundary
+    void parseLines(const char *p, const char *end, const std::int64_t column, const char sep, Column &out) {
+        while (p < end) {
+            const char *nl = findNewline(p, end);
+            const char *lineEnd = nl > p && nl[-1] == '\r' ? nl - 1 : nl;
+            if (lineEnd > p) {
+                out.push(parseField(p, lineEnd, column, sep));
+            }
+            p = nl + 1;
+        }
+    }
+
+    // below this a thread costs more than it saves
+    constexpr std::int64_t PARALLEL_CHUNK = 8 << 20;
+
+    // fixed size so writes can look a writer up without a lock
+    constexpr int MAX_WRITERS = 1024;
+    constexpr std::size_t WRITE_BUFFER = 256 * 1024;
+
+    struct Writer {
+        std::mutex lock;
+        int fd = -1;
+        std::size_t used = 0;
+        char buf[WRITE_BUFFER];
+    };
+
+    std::atomic<Writer *> writers[MAX_WRITERS];
+    std::mutex openLock;
+    std::once_flag flushAtExit;
+
+    void writeOut(const int fd, const char *data, std::size_t size) {
+        while (size > 0) {
+            const ssize_t n = ::write(fd, data, size);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                fail(std::string("write failed: ") + std::strerror(errno));
+            }
+            data += n;
+            size -= static_cast<std::size_t>(n);
+        }
+    }
+
+    void flush(Writer &w) {
+        writeOut(w.fd, w.buf, w.used);
+        w.used = 0;
+    }
+
+    void append(Writer &w, const char *data, const std::size_t size) {
+        if (size > WRITE_BUFFER - w.used) {
+            flush(w);
+            if (size >= WRITE_BUFFER) {
+                writeOut(w.fd, data, size);
+                return;
+            }
+        }
+        std::memcpy(w.buf + w.used, data, size);
+        w.used += size;
+    }
+
+    // the writer behind a handle, locked
+    Writer &lockWriter(const std::int64_t handle) {
+        Writer *w = handle >= 0 && handle < MAX_WRITERS
+                        ? writers[handle].load(std::memory_order_acquire)
+                        : nullptr;
+        if (w) {
+            w->lock.lock();
+            if (w->fd >= 0) {
+                return *w;
+            }
+            w->lock.unlock();
+        }
+        fail("write to a writer that isn't open");
+    }
+
+    void flushAll() {
+        for (auto &slot: writers) {
+            if (Writer *w = slot.load(std::memory_order_acquire)) {
+                std::lock_guard guard(w->lock);
+                if (w->fd >= 0) {
+                    flush(*w);
+                }
+            }
+        }
+    }
+}
+
+// the whole file as a str. files that can't be mapped, like pipes, are read
+// into memory instead
+extern "C" void __cblt_read_file(const char *path, const std::int64_t pathLen, Str *out) {
+    const std::string name = pathOf(path, pathLen);
+    const int fd = open(name.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fail("can't read " + name + ": " + std::strerror(errno));
+    }
+    struct stat st{};
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        if (st.st_size == 0) {
+            close(fd);
+            *out = {"", 0};
+            return;
+        }
+        void *map = mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            madvise(map, static_cast<std::size_t>(st.st_size), MADV_SEQUENTIAL);
+            close(fd);
+            *out = {static_cast<const char *>(map), st.st_size};
+            return;
+        }
+    }
+
+    std::size_t cap = 1 << 20;
+    std::size_t size = 0;
+    auto *data = static_cast<char *>(std::malloc(cap));
+    for (;;) {
+        if (!data) {
+            fail("out of memory reading " + name);
+        }
+        const ssize_t n = read(fd, data + size, cap - size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fail("can't read " + name + ": " + std::strerror(errno));
+        }
+        if (n == 0) {
+            break;
+        }
+        size += static_cast<std::size_t>(n);
+        if (size == cap) {
+            cap *= 2;
+            data = static_cast<char *>(std::realloc(data, cap));
+        }
+    }
+    close(fd);
+    *out = {data, static_cast<std::int64_t>(size)};
+}
+
+// index of the first newline at or after from, len when there is none
+extern "C" std::int64_t __cblt_line_end(const char *data, const std::int64_t len, const std::int64_t from) {
+    if (from >= len) {
+        return len;
+    }
+    return findNewline(data + std::max<std::int64_t>(from, 0), data + len) - data;
+}
+
+// field column of every non empty line as a num, fields split by the one
+// byte in sep. a line without that field, or whose field holds anything
+// but a num and the spaces and tabs around it, gives NaN
+extern "C" void __cblt_parse_column(const char *data, const std::int64_t len, const std::int64_t column,
+                                    const char *sep, const std::int64_t sepLen, Array *out) {
+    if (sepLen != 1) {
+        fail("parseColumn needs a one byte separator");
+    }
+    if (column < 0) {
+        fail("parseColumn needs a column of 0 or more");
+    }
+
+    const char *end = data + len;
+    const std::int64_t threads = std::min<std::int64_t>(
+        std::max(1u, std::thread::hardware_concurrency()), len / PARALLEL_CHUNK + 1);
+    std::vector<Column> parts(threads);
+    if (threads == 1) {
+        parseLines(data, end, column, *sep, parts[0]);
+        *out = {parts[0].data ? parts[0].data : static_cast<double *>(std::malloc(sizeof(double))),
+                static_cast<std::int64_t>(parts[0].len)};
+        return;
+    }
+
+    // chunks start right after a newline so no line is split
+    std::vector<const char *> bounds{data};
+    for (std::int64_t i = 1; i < threads; i++) {
+        const char *at = std::max(data + len / threads * i, bounds.back());
+        const char *nl = findNewline(at, end);
+        bounds.push_back(nl == end ? end : nl + 1);
+    }
+    bounds.push_back(end);
+    std::vector<std::thread> workers;
+    for (std::int64_t i = 1; i < threads; i++) {
+        workers.emplace_back([&, i] { parseLines(bounds[i], bounds[i + 1], column, *sep, parts[i]); });
+    }
+    parseLines(bounds[0], bounds[1], column, *sep, parts[0]);
+    for (std::thread &t: workers) {
+        t.join();
+    }
+
+    std::size_t count = 0;
+    for (const Column &part: parts) {
+        count += part.len;
+    }
+    auto *values = static_cast<double *>(std::malloc(std::max<std::size_t>(count, 1) * sizeof(double)));
+    if (!values) {
+        fail("out of memory for parseColumn");
+    }
+    double *at = values;
+    for (const Column &part: parts) {
+        at = std::copy(part.data, part.data + part.len, at);
+        std::free(part.data);
+    }
+    *out = {values, static_cast<std::int64_t>(count)};
+}
+
+// "-" is stdout
+extern "C" std::int64_t __cblt_writer_open(const char *path, const std::int64_t pathLen) {
+    const std::string name = pathOf(path, pathLen);
+    const int fd = name == "-" ? STDOUT_FILENO : open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        fail("can't write " + name + ": " + std::strerror(errno));
+    }
+    std::call_once(flushAtExit, [] { std::atexit(flushAll); });
+
+    std::lock_guard guard(openLock);
+    for (std::int64_t i = 0; i < MAX_WRITERS; i++) {
+        Writer *w = writers[i].load(std::memory_order_relaxed);
+        if (!w) {
+            w = new Writer;
+            w->fd = fd;
+            writers[i].store(w, std::memory_order_release);
+            return i;
+        }
+        std::lock_guard slot(w->lock);
+        if (w->fd < 0) {
+            w->fd = fd;
+            return i;
+        }
+    }
+    fail("too many open writers");
+}
+
+extern "C" void __cblt_write(const std::int64_t handle, const char *data, const std::int64_t len) {
+    Writer &w = lockWriter(handle);
+    std::lock_guard guard(w.lock, std::adopt_lock);
+    append(w, data, static_cast<std::size_t>(len));
+}
+
+extern "C" void __cblt_write_line(const std::int64_t handle, const char *data, const std::int64_t len) {
+    Writer &w = lockWriter(handle);
+    std::lock_guard guard(w.lock, std::adopt_lock);
+    append(w, data, static_cast<std::size_t>(len));
+    append(w, "\n", 1);
+}
+
+// shortest text that reads back as the same num
+extern "C" void __cblt_write_num(const std::int64_t handle, const double value) {
+    char text[32];
+    const auto [end, ec] = std::to_chars(text, text + sizeof(text), value);
+    Writer &w = lockWriter(handle);
+    std::lock_guard guard(w.lock, std::adopt_lock);
+    append(w, text, static_cast<std::size_t>(end - text));
+}
+
+extern "C" void __cblt_writer_close(const std::int64_t handle) {
+    Writer &w = lockWriter(handle);
+    std::lock_guard guard(w.lock, std::adopt_lock);
+    flush(w);
+    if (w.fd != STDOUT_FILENO) {
+        close(w.fd);
+    }
+    w.fd = -1;
+}
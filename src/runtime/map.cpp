@@ -0,0 +1,180 @@
+// runtime half of map literals, linked into compiled cobalt programs. the
+// layout and hashing live in map.h so the compiler can lay out constant
+// literals the same way. like the program's other heap values a map and its
+// table live until exit, only the table a grow replaces is freed
+#include "map.h"
+#include <cstdio>
+#include <cstdlib>
+
+using namespace cblt::rt;
+
+extern "C" void *__cblt_alloc(std::uint64_t size);
+
+namespace {
+    struct NumKey {
+        using Slot = NumSlot;
+        double key; // canonical
+
+        [[nodiscard]] std::uint64_t hash() const {
+            return hashNum(key);
+        }
+
+        [[nodiscard]] bool matches(const Slot &slot) const {
+            return keyBits(slot.key) == keyBits(key);
+        }
+
+        static std::uint64_t rehash(const Slot &slot) {
+            return hashNum(slot.key);
+        }
+    };
+
+    struct StrKey {
+        using Slot = StrSlot;
+        const char *data;
+        std::uint64_t len;
+
+        [[nodiscard]] std::uint64_t hash() const {
+            return hashStr(data, len);
+        }
+
+        [[nodiscard]] bool matches(const Slot &slot) const {
+            return slot.len == len && std::memcmp(slot.data, data, len) == 0;
+        }
+
+        static std::uint64_t rehash(const Slot &slot) {
+            return hashStr(slot.data, slot.len);
+        }
+    };
+
+    template<typename Key>
+    typename Key::Slot *find(const Map *map, const Key &key) {
+        auto *slots = static_cast<typename Key::Slot *>(map->slots);
+        const std::uint64_t hash = key.hash();
+        const std::int8_t tag = h2(hash);
+        for (ProbeSeq seq(hash, map->capacity);; seq.next()) {
+            const Group group(map->ctrl + seq.offset);
+            for (std::uint32_t bits = group.match(tag); bits; bits &= bits - 1) {
+                typename Key::Slot &slot = slots[seq.slot(__builtin_ctz(bits))];
+                if (key.matches(slot)) {
+                    return &slot;
+                }
+            }
+            if (group.matchEmpty()) {
+                return nullptr;
+            }
+        }
+    }
+
+    [[noreturn]] void outOfMemory() {
+        std::fprintf(stderr, "cobalt: out of memory growing a map\n");
+        std::abort();
+    }
+
+    template<typename Slot>
+    void allocTable(Map *map, const std::uint64_t capacity) {
+        map->ctrl = static_cast<std::int8_t *>(std::malloc(capacity + GROUP_WIDTH));
+        map->slots = std::calloc(capacity, sizeof(Slot));
+        if (!map->ctrl || !map->slots) {
+            outOfMemory();
+        }
+        std::memset(map->ctrl, CTRL_EMPTY, capacity + GROUP_WIDTH);
+        map->capacity = capacity;
+        map->growthLeft = growthFor(capacity) - map->size;
+    }
+
+    template<typename Key>
+    void grow(Map *map) {
+        using Slot = typename Key::Slot;
+        const Map old = *map;
+        allocTable<Slot>(map, old.capacity * 2);
+
+        const auto *oldSlots = static_cast<const Slot *>(old.slots);
+        auto *slots = static_cast<Slot *>(map->slots);
+        for (std::uint64_t i = 0; i < old.capacity; i++) {
+            if (old.ctrl[i] == CTRL_EMPTY) {
+                continue;
+            }
+            const std::uint64_t hash = Key::rehash(oldSlots[i]);
+            const std::uint64_t at = findEmpty(map->ctrl, map->capacity, hash);
+            setCtrl(map->ctrl, map->capacity, at, h2(hash));
+            slots[at] = oldSlots[i];
+        }
+        std::free(old.ctrl);
+        std::free(old.slots);
+    }
+
+    // the slot for key, fresh ones are zeroed
+    template<typename Key>
+    typename Key::Slot *insert(Map *map, const Key &key, bool &fresh) {
+        fresh = false;
+        if (auto *slot = find(map, key)) {
+            return slot;
+        }
+        if (!map->growthLeft) {
+            grow<Key>(map);
+        }
+        const std::uint64_t hash = key.hash();
+        const std::uint64_t at = findEmpty(map->ctrl, map->capacity, hash);
+        setCtrl(map->ctrl, map->capacity, at, h2(hash));
+        map->size++;
+        map->growthLeft--;
+        fresh = true;
+        return static_cast<typename Key::Slot *>(map->slots) + at;
+    }
+
+    template<typename Slot>
+    Map *newMap(const std::uint64_t n) {
+        auto *map = static_cast<Map *>(__cblt_alloc(sizeof(Map)));
+        map->size = 0;
+        allocTable<Slot>(map, capacityFor(n));
+        return map;
+    }
+}
+
+// maps built here are only ever read after the literal that made them, the
+// constant ones the compiler lays out live in read only data
+
+extern "C" Map *__cblt_nummap_new(const std::uint64_t n) {
+    return newMap<NumSlot>(n);
+}
+
+extern "C" void __cblt_nummap_insert(Map *map, const double key, const double value) {
+    bool fresh;
+    const NumKey canonical{canonicalKey(key)};
+    NumSlot *slot = insert(map, canonical, fresh);
+    slot->key = canonical.key;
+    slot->value = value;
+}
+
+extern "C" double __cblt_nummap_get(const Map *map, const double key) {
+    if (const NumSlot *slot = find(map, NumKey{canonicalKey(key)})) {
+        return slot->value;
+    }
+    std::fprintf(stderr, "cobalt: key %g not in map\n", key);
+    std::abort();
+}
+
+extern "C" Map *__cblt_strmap_new(const std::uint64_t n) {
+    return newMap<StrSlot>(n);
+}
+
+// keys are copied, the str passed in may live in a region
+extern "C" void __cblt_strmap_insert(Map *map, const char *data, const std::uint64_t len, const double value) {
+    bool fresh;
+    StrSlot *slot = insert(map, StrKey{data, len}, fresh);
+    if (fresh) {
+        char *key = static_cast<char *>(__cblt_alloc(len));
+        std::memcpy(key, data, len);
+        slot->data = key;
+        slot->len = len;
+    }
+    slot->value = value;
+}
+
+extern "C" double __cblt_strmap_get(const Map *map, const char *data, const std::uint64_t len) {
+    if (const StrSlot *slot = find(map, StrKey{data, len})) {
+        return slot->value;
+    }
+    std::fprintf(stderr, "cobalt: key \"%.*s\" not in map\n", static_cast<int>(len), data);
+    std::abort();
+}
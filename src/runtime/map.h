@@ -0,0 +1,186 @@
+#pragma once
+
+#ifndef CBLT_MAP_H
+#define CBLT_MAP_H
+
+// layout and hashing shared by the map runtime and the compiler, which lays
+// out constant map literals itself. open addressing with one control byte per
+// slot, probed a group of 16 at a time
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace cblt::rt {
+    constexpr std::uint64_t GROUP_WIDTH = 16;
+    constexpr std::int8_t CTRL_EMPTY = -128; // full slots hold the low 7 hash bits, maps never delete
+
+    // ctrl has capacity + GROUP_WIDTH bytes, the tail mirrors the first group
+    // so a group load never wraps
+    struct Map {
+        std::int8_t *ctrl;
+        void *slots;
+        std::uint64_t capacity; // power of two, at least GROUP_WIDTH
+        std::uint64_t size;
+        std::uint64_t growthLeft;
+    };
+
+    struct NumSlot {
+        double key;
+        double value;
+    };
+
+    struct StrSlot {
+        const char *data;
+        std::uint64_t len;
+        double value;
+    };
+
+    // 7/8 max load
+    inline std::uint64_t capacityFor(const std::uint64_t n) {
+        std::uint64_t capacity = GROUP_WIDTH;
+        while (n > capacity - capacity / 8) {
+            capacity *= 2;
+        }
+        return capacity;
+    }
+
+    inline std::uint64_t growthFor(const std::uint64_t capacity) {
+        return capacity - capacity / 8;
+    }
+
+    inline std::uint64_t mix(const std::uint64_t a, const std::uint64_t b) {
+        const unsigned __int128 r = static_cast<unsigned __int128>(a) * b;
+        return static_cast<std::uint64_t>(r) ^ static_cast<std::uint64_t>(r >> 64);
+    }
+
+    constexpr std::uint64_t SEED = 0x243f6a8885a308d3;
+    constexpr std::uint64_t MUL = 0x9e3779b97f4a7c15;
+
+    // -0 and 0 are the same key, and so is every NaN, so canonical keys
+    // compare by their bits
+    inline double canonicalKey(const double key) {
+        if (key == 0) {
+            return 0;
+        }
+        return key != key ? std::numeric_limits<double>::quiet_NaN() : key;
+    }
+
+    inline std::uint64_t keyBits(const double key) {
+        std::uint64_t bits;
+        std::memcpy(&bits, &key, sizeof(bits));
+        return bits;
+    }
+
+    inline std::uint64_t hashNum(const double key) {
+        return mix(keyBits(canonicalKey(key)) ^ SEED, MUL);
+    }
+
+    template<typename T>
+    T load(const char *p) {
+        T v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    // fixed size loads only, the tail of a long key overlaps its last word
+    inline std::uint64_t hashStr(const char *data, const std::uint64_t len) {
+        std::uint64_t h = SEED ^ len;
+        if (len <= 8) {
+            std::uint64_t word = 0;
+            if (len >= 4) {
+                word = static_cast<std::uint64_t>(load<std::uint32_t>(data + len - 4)) << 32 |
+                       load<std::uint32_t>(data);
+            } else if (len) {
+                word = static_cast<std::uint64_t>(static_cast<unsigned char>(data[0])) << 16 |
+                       static_cast<std::uint64_t>(static_cast<unsigned char>(data[len / 2])) << 8 |
+                       static_cast<unsigned char>(data[len - 1]);
+            }
+            return mix(mix(h ^ word, MUL), MUL);
+        }
+
+        const char *end = data + len;
+        for (; end - data > 8; data += 8) {
+            h = mix(h ^ load<std::uint64_t>(data), MUL);
+        }
+        h = mix(h ^ load<std::uint64_t>(end - 8), MUL);
+        return mix(h, MUL);
+    }
+
+    inline std::uint64_t h1(const std::uint64_t hash) {
+        return hash >> 7;
+    }
+
+    inline std::int8_t h2(const std::uint64_t hash) {
+        return static_cast<std::int8_t>(hash & 0x7f);
+    }
+
+    // bit i is set when ctrl byte i of the group matches
+    struct Group {
+#ifdef __SSE2__
+        __m128i ctrl;
+
+        explicit Group(const std::int8_t *pos) : ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pos))) {}
+
+        [[nodiscard]] std::uint32_t match(const std::int8_t h) const {
+            return static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h), ctrl)));
+        }
+#else
+        const std::int8_t *ctrl;
+
+        explicit Group(const std::int8_t *pos) : ctrl(pos) {}
+
+        [[nodiscard]] std::uint32_t match(const std::int8_t h) const {
+            std::uint32_t bits = 0;
+            for (std::uint32_t i = 0; i < GROUP_WIDTH; i++) {
+                bits |= static_cast<std::uint32_t>(ctrl[i] == h) << i;
+            }
+            return bits;
+        }
+#endif
+
+        [[nodiscard]] std::uint32_t matchEmpty() const {
+            return match(CTRL_EMPTY);
+        }
+    };
+
+    // groups are visited at triangular offsets, which covers the whole table
+    // when the capacity is a power of two
+    struct ProbeSeq {
+        std::uint64_t mask;
+        std::uint64_t offset;
+        std::uint64_t index = 0;
+
+        ProbeSeq(const std::uint64_t hash, const std::uint64_t capacity)
+            : mask(capacity - 1), offset(h1(hash) & (capacity - 1)) {}
+
+        [[nodiscard]] std::uint64_t slot(const std::uint32_t bit) const {
+            return (offset + bit) & mask;
+        }
+
+        void next() {
+            index += GROUP_WIDTH;
+            offset = (offset + index) & mask;
+        }
+    };
+
+    inline void setCtrl(std::int8_t *ctrl, const std::uint64_t capacity, const std::uint64_t i, const std::int8_t h) {
+        ctrl[i] = h;
+        if (i < GROUP_WIDTH) {
+            ctrl[capacity + i] = h;
+        }
+    }
+
+    // where a key known to be absent goes
+    inline std::uint64_t findEmpty(const std::int8_t *ctrl, const std::uint64_t capacity, const std::uint64_t hash) {
+        for (ProbeSeq seq(hash, capacity);; seq.next()) {
+            if (const std::uint32_t empty = Group(ctrl + seq.offset).matchEmpty()) {
+                return seq.slot(__builtin_ctz(empty));
+            }
+        }
+    }
+}
+
+#endif //CBLT_MAP_H
@@ -0,0 +1,69 @@
+// runtime half of -fprofile-generate, linked into instrumented programs
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+    struct ProfModule {
+        std::uint64_t **counters;
+        const char **names;
+        std::uint64_t n;
+        std::string path;
+    };
+
+    std::vector<ProfModule> &modules() {
+        static std::vector<ProfModule> mods;
+        return mods;
+    }
+
+    // merges this run into whatever earlier runs left in the file
+    void dumpProfiles() {
+        std::map<std::string, std::map<std::string, std::uint64_t>> byPath;
+        for (const ProfModule &mod: modules()) {
+            auto &counts = byPath[mod.path];
+            for (std::uint64_t i = 0; i < mod.n; i++) {
+                counts[mod.names[i]] += *mod.counters[i];
+            }
+        }
+
+        for (auto &[path, counts]: byPath) {
+            std::ifstream in(path);
+            std::string line;
+            while (std::getline(in, line)) {
+                if (line.empty() || line[0] == '#') {
+                    continue;
+                }
+                std::istringstream ss(line);
+                std::string site;
+                std::uint64_t count;
+                if (ss >> site >> count) {
+                    counts[site] += count;
+                }
+            }
+            in.close();
+
+            std::ofstream out(path, std::ios::trunc);
+            if (!out) {
+                std::fprintf(stderr, "cobalt: could not write profile %s\n", path.c_str());
+                continue;
+            }
+            out << "# cobalt profile v1\n";
+            for (const auto &[site, count]: counts) {
+                out << site << ' ' << count << '\n';
+            }
+        }
+    }
+}
+
+extern "C" void __cblt_prof_register(std::uint64_t **counters, const char **names, const std::uint64_t n,
+                                     const char *path) {
+    if (modules().empty()) {
+        std::atexit(dumpProfiles);
+    }
+    modules().push_back({counters, names, n, path});
+}
@@ -0,0 +1,466 @@
+// tasks for async fncs, linked into compiled cobalt programs. an async fnc is
+// an llvm switched-resume coroutine, spawn makes a Task for it and pushes it
+// on the spawning thread's deque. one worker thread per core runs tasks,
+// popping its own deque from the bottom and stealing from the top of the
+// others'. a task that awaits an unfinished one suspends and is pushed again
+// by whoever finishes that one. a thread that awaits outside an async fnc
+// runs other tasks meanwhile, and blocks once there are none.
+// CBLT_WORKERS in the environment sets the number of workers.
+// a spawned Task is never freed, like the program's other heap values. once
+// its result is taken it stays behind marked TAKEN, so a second await of the
+// same handle aborts instead of reading freed memory
+#include <algorithm>
+#include <atomic>
+#include <coroutine>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <semaphore>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+    // what spawn hands the program. generated code stores the fnc's result
+    // through a pointer to the Task, so result has to stay first
+    struct Task {
+        double result;
+        void *frame;
+        // 0 while running, DONE once result is set, TAKEN once it's been
+        // awaited, otherwise who awaits it: a Task, or a Blocked thread
+        // tagged with BLOCKED
+        std::atomic<std::uintptr_t> state;
+        Task *awaiting; // set by the coroutine right before it suspends on another task
+    };
+
+    constexpr std::uintptr_t DONE = 1;
+    constexpr std::uintptr_t BLOCKED = 2;
+    constexpr std::uintptr_t TAKEN = 3; // a Blocked is aligned, so never BLOCKED | it
+
+    struct Blocked {
+        std::atomic<int> woken;
+    };
+
+    [[noreturn]] void fail(const char *msg) {
+        std::fprintf(stderr, "cobalt: %s\n", msg);
+        std::abort();
+    }
+
+    // frames and Tasks. unlike the pools in heap.cpp a frame is usually freed
+    // by another thread than the one that made it, so a thread whose free list
+    // grows past two batches hands one back to a central list the others
+    // refill from, and spawning from one thread forever doesn't grow forever
+    constexpr std::size_t GRAIN = 16;
+    constexpr std::size_t MAX_POOLED = 2048;
+    constexpr std::size_t CLASS_COUNT = MAX_POOLED / GRAIN;
+    constexpr std::uint32_t BATCH = 64;
+    constexpr std::size_t SLAB_SIZE = 256 * 1024;
+
+    struct FreeBlock {
+        FreeBlock *next;
+        FreeBlock *nextBatch; // only read on the first block of a central batch
+    };
+
+    struct alignas(64) Central {
+        std::mutex lock;
+        FreeBlock *batches = nullptr;
+    };
+
+    Central central[CLASS_COUNT];
+
+    // trivially destructible so the fast paths skip the tls init guard
+    struct ThreadPool {
+        FreeBlock *lists[CLASS_COUNT];
+        std::uint32_t counts[CLASS_COUNT];
+        char *slab;
+        char *slabEnd;
+    };
+
+    thread_local ThreadPool pool;
+
+    std::size_t classOf(const std::uint64_t size) {
+        return size ? (size - 1) / GRAIN : 0;
+    }
+
+    [[gnu::noinline]] void refill(const std::size_t cls) {
+        {
+            Central &c = central[cls];
+            std::lock_guard guard(c.lock);
+            if (FreeBlock *batch = c.batches) {
+                c.batches = batch->nextBatch;
+                pool.lists[cls] = batch;
+                pool.counts[cls] = BATCH;
+                return;
+            }
+        }
+        const std::size_t size = (cls + 1) * GRAIN;
+        for (std::uint32_t i = 0; i < BATCH; i++) {
+            if (static_cast<std::size_t>(pool.slabEnd - pool.slab) < size) {
+                pool.slab = static_cast<char *>(std::aligned_alloc(GRAIN, SLAB_SIZE));
+                if (!pool.slab) {
+                    fail("out of memory for tasks");
+                }
+                pool.slabEnd = pool.slab + SLAB_SIZE;
+            }
+            auto *block = reinterpret_cast<FreeBlock *>(pool.slab);
+            pool.slab += size;
+            block->next = pool.lists[cls];
+            pool.lists[cls] = block;
+            pool.counts[cls]++;
+        }
+    }
+
+    void *poolAlloc(const std::size_t cls) {
+        if (!pool.lists[cls]) {
+            refill(cls);
+        }
+        FreeBlock *block = pool.lists[cls];
+        pool.lists[cls] = block->next;
+        pool.counts[cls]--;
+        return block;
+    }
+
+    [[gnu::noinline]] void giveBack(const std::size_t cls) {
+        FreeBlock *batch = pool.lists[cls];
+        FreeBlock *last = batch;
+        for (std::uint32_t i = 1; i < BATCH; i++) {
+            last = last->next;
+        }
+        pool.lists[cls] = last->next;
+        pool.counts[cls] -= BATCH;
+        last->next = nullptr;
+
+        Central &c = central[cls];
+        std::lock_guard guard(c.lock);
+        batch->nextBatch = c.batches;
+        c.batches = batch;
+    }
+
+    void poolFree(void *ptr, const std::size_t cls) {
+        auto *block = static_cast<FreeBlock *>(ptr);
+        block->next = pool.lists[cls];
+        pool.lists[cls] = block;
+        if (++pool.counts[cls] > 2 * BATCH) {
+            giveBack(cls);
+        }
+    }
+
+    constexpr std::size_t TASK_CLASS = (sizeof(Task) - 1) / GRAIN;
+
+    // chase-lev deque of runnable tasks. the owner pushes and pops at the
+    // bottom, thieves take from the top. rings a grown deque replaced stay
+    // allocated, a thief may still be reading one
+    struct Ring {
+        std::int64_t capacity;
+        std::atomic<Task *> *slots;
+
+        explicit Ring(const std::int64_t capacity)
+            : capacity(capacity), slots(new std::atomic<Task *>[capacity]) {
+        }
+
+        [[nodiscard]] Task *get(const std::int64_t i) const {
+            return slots[i & (capacity - 1)].load(std::memory_order_relaxed);
+        }
+
+        void put(const std::int64_t i, Task *task) const {
+            slots[i & (capacity - 1)].store(task, std::memory_order_relaxed);
+        }
+    };
+
+    struct alignas(64) Deque {
+        std::atomic<std::int64_t> top{0};
+        std::atomic<std::int64_t> bottom{0};
+        std::atomic<Ring *> ring{new Ring(1024)};
+        std::vector<Ring *> retired;
+
+        void push(Task *task) {
+            const std::int64_t b = bottom.load(std::memory_order_relaxed);
+            const std::int64_t t = top.load(std::memory_order_acquire);
+            Ring *r = ring.load(std::memory_order_relaxed);
+            if (b - t >= r->capacity) {
+                auto *bigger = new Ring(r->capacity * 2);
+                for (std::int64_t i = t; i < b; i++) {
+                    bigger->put(i, r->get(i));
+                }
+                retired.push_back(r);
+                ring.store(bigger, std::memory_order_release);
+                r = bigger;
+            }
+            r->put(b, task);
+            std::atomic_thread_fence(std::memory_order_release);
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+
+        Task *pop() {
+            const std::int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+            Ring *r = ring.load(std::memory_order_relaxed);
+            bottom.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            std::int64_t t = top.load(std::memory_order_relaxed);
+            if (t > b) {
+                bottom.store(b + 1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            Task *task = r->get(b);
+            if (t == b) {
+                // the last one, a thief may be taking it too
+                if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                    task = nullptr;
+                }
+                bottom.store(b + 1, std::memory_order_relaxed);
+            }
+            return task;
+        }
+
+        Task *steal() {
+            std::int64_t t = top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            const std::int64_t b = bottom.load(std::memory_order_acquire);
+            if (t >= b) {
+                return nullptr;
+            }
+            Task *task = ring.load(std::memory_order_acquire)->get(t);
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                return nullptr;
+            }
+            return task;
+        }
+    };
+
+    // every thread that spawns or runs tasks has a deque here, in the order
+    // they first did. a thread reserves its slot before filling it in, so a
+    // slot below the count can still be null for a moment
+    constexpr int MAX_THREADS = 512;
+    std::atomic<Deque *> deques[MAX_THREADS];
+    std::atomic<int> dequeCount{0};
+    thread_local Deque *own;
+    thread_local std::uint32_t stealSeed;
+
+    Deque &ownDeque() {
+        if (!own) {
+            const int index = dequeCount.fetch_add(1, std::memory_order_relaxed);
+            if (index >= MAX_THREADS) {
+                fail("too many threads running tasks");
+            }
+            own = new Deque;
+            stealSeed = static_cast<std::uint32_t>(index) * 2654435761u + 1;
+            deques[index].store(own, std::memory_order_release);
+        }
+        return *own;
+    }
+
+    // workers with nothing to do wait on the semaphore. whoever makes work
+    // claims a sleeper before releasing it, so a burst of spawns wakes one
+    // worker rather than making a syscall each, and the woken worker wakes the
+    // next once it finds work
+    std::atomic<int> sleepers{0};
+    std::counting_semaphore<> wakeups(0);
+
+    void notify() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int n = sleepers.load(std::memory_order_relaxed);
+        while (n > 0) {
+            if (sleepers.compare_exchange_weak(n, n - 1, std::memory_order_relaxed)) {
+                wakeups.release();
+                return;
+            }
+        }
+    }
+
+    Task *findWork() {
+        Deque &mine = ownDeque();
+        if (Task *task = mine.pop()) {
+            return task;
+        }
+        const int count = std::min(dequeCount.load(std::memory_order_relaxed), MAX_THREADS);
+        stealSeed ^= stealSeed << 13;
+        stealSeed ^= stealSeed >> 17;
+        stealSeed ^= stealSeed << 5;
+        const int start = static_cast<int>(stealSeed % static_cast<std::uint32_t>(count));
+        for (int i = 0; i < count; i++) {
+            Deque *victim = deques[(start + i) % count].load(std::memory_order_acquire);
+            if (!victim || victim == &mine) {
+                continue;
+            }
+            if (Task *task = victim->steal()) {
+                notify(); // there may be more where that came from
+                return task;
+            }
+        }
+        return nullptr;
+    }
+
+    void schedule(Task *task) {
+        ownDeque().push(task);
+        notify();
+    }
+
+    // the result is in, whoever awaits it carries on
+    void finish(Task *task) {
+        const std::uintptr_t waiter = task->state.exchange(DONE, std::memory_order_acq_rel);
+        if (waiter & BLOCKED) {
+            auto *blocked = reinterpret_cast<Blocked *>(waiter & ~BLOCKED);
+            blocked->woken.store(1, std::memory_order_release);
+            blocked->woken.notify_one();
+        } else if (waiter) {
+            schedule(reinterpret_cast<Task *>(waiter));
+        }
+    }
+
+    // resumes task until it finishes or suspends on an unfinished task, in
+    // which case it's left for that one to reschedule
+    void run(Task *task) {
+        const std::coroutine_handle<> handle = std::coroutine_handle<>::from_address(task->frame);
+        for (;;) {
+            handle.resume();
+            if (handle.done()) {
+                handle.destroy();
+                finish(task);
+                return;
+            }
+            Task *on = std::exchange(task->awaiting, nullptr);
+            std::uintptr_t expected = 0;
+            if (on->state.compare_exchange_strong(expected, reinterpret_cast<std::uintptr_t>(task),
+                                                  std::memory_order_acq_rel)) {
+                return;
+            }
+            if (expected != DONE) {
+                fail("a task was awaited twice");
+            }
+            // finished since the coroutine looked, no need to go through a deque
+        }
+    }
+
+    void work() {
+        for (;;) {
+            if (Task *task = findWork()) {
+                run(task);
+                continue;
+            }
+            sleepers.fetch_add(1, std::memory_order_seq_cst);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (Task *task = findWork()) {
+                // take back the sleeper, unless a notify already claimed it
+                int n = sleepers.load(std::memory_order_relaxed);
+                while (n > 0 && !sleepers.compare_exchange_weak(n, n - 1, std::memory_order_relaxed)) {
+                }
+                run(task);
+                continue;
+            }
+            wakeups.acquire();
+        }
+    }
+
+    std::once_flag started;
+
+    void start() {
+        std::call_once(started, [] {
+            unsigned workers = std::thread::hardware_concurrency();
+            if (const char *env = std::getenv("CBLT_WORKERS"); env && std::atoi(env) > 0) {
+                workers = static_cast<unsigned>(std::atoi(env));
+            }
+            workers = std::max(1u, std::min(workers, static_cast<unsigned>(MAX_THREADS / 2)));
+            for (unsigned i = 0; i < workers; i++) {
+                std::thread(work).detach();
+            }
+        });
+    }
+
+    // blocks until task is finished, or taken already, running other tasks
+    // while there are any
+    void waitFor(Task *task) {
+        start();
+        for (std::uintptr_t s; (s = task->state.load(std::memory_order_acquire)) != DONE && s != TAKEN;) {
+            if (Task *other = findWork()) {
+                run(other);
+                continue;
+            }
+            Blocked blocked{0};
+            std::uintptr_t expected = 0;
+            if (task->state.compare_exchange_strong(expected, reinterpret_cast<std::uintptr_t>(&blocked) | BLOCKED,
+                                                    std::memory_order_acq_rel)) {
+                while (!blocked.woken.load(std::memory_order_acquire)) {
+                    blocked.woken.wait(0, std::memory_order_acquire);
+                }
+                return;
+            }
+            if (expected != DONE) {
+                fail("a task was awaited twice");
+            }
+        }
+    }
+}
+
+extern "C" void *__cblt_frame_alloc(const std::uint64_t size) {
+    if (size > MAX_POOLED) {
+        void *ptr = std::aligned_alloc(GRAIN, (size + GRAIN - 1) & ~(GRAIN - 1));
+        if (!ptr) {
+            fail("out of memory for a task");
+        }
+        return ptr;
+    }
+    return poolAlloc(classOf(size));
+}
+
+// size is the frame's, null when the frame was elided into its caller's
+extern "C" void __cblt_frame_free(void *frame, const std::uint64_t size) {
+    if (!frame) {
+        return;
+    }
+    if (size > MAX_POOLED) {
+        std::free(frame);
+        return;
+    }
+    poolFree(frame, classOf(size));
+}
+
+extern "C" Task *__cblt_task_new() {
+    return new(poolAlloc(TASK_CLASS)) Task{0, nullptr, {0}, nullptr};
+}
+
+// frame is the coroutine of a spawned fnc, suspended before its first statement
+extern "C" void __cblt_task_schedule(Task *task, void *frame) {
+    task->frame = frame;
+    start();
+    schedule(task);
+}
+
+// called by a coroutine running as self about to await task, true when there
+// is no need to suspend
+extern "C" bool __cblt_task_await(Task *self, Task *task) {
+    // a TAKEN one goes straight on to __cblt_task_take, which reports it
+    if (const std::uintptr_t s = task->state.load(std::memory_order_acquire); s == DONE || s == TAKEN) {
+        return true;
+    }
+    self->awaiting = task;
+    return false;
+}
+
+// the result of a finished task, the program's handle to it is used up
+extern "C" double __cblt_task_take(Task *task) {
+    if (task->state.exchange(TAKEN, std::memory_order_acq_rel) != DONE) {
+        fail("a task was awaited twice");
+    }
+    return task->result;
+}
+
+// await outside an async fnc
+extern "C" double __cblt_task_wait(Task *task) {
+    waitFor(task);
+    return __cblt_task_take(task);
+}
+
+// await of an async fnc outside an async fnc. the coroutine has run up to
+// its first suspend on self's behalf, this thread carries it the rest of the
+// way. the caller frees the frame, it may be in the caller's own
+extern "C" void __cblt_task_drive(Task *self, void *frame) {
+    const std::coroutine_handle<> handle = std::coroutine_handle<>::from_address(frame);
+    while (!handle.done()) {
+        waitFor(std::exchange(self->awaiting, nullptr));
+        handle.resume();
+    }
+    self->~Task();
+    poolFree(self, TASK_CLASS);
+}
@@ -0,0 +1,235 @@
+#include "../h/sema.h"
+#include <map>
+
+using namespace cblt::ast;
+
+namespace cblt::sema {
+    // a fnc value escapes unless every use of it is as a callee, or as an
+    // argument to a top level fnc whose matching param doesn't escape. binding
+    // it to another decl, returning it, capturing it or storing it all count.
+    // arrays and str concatenations are the same, except that indexing them or
+    // using them as an operand only reads them. extern params never escape, c
+    // code may only hold on to a pointer for the length of the call
+    class EscapeAnalysis {
+        std::map<std::string, FuncLiteral *> globals;
+        // builtins that only read their args start out here, slice isn't one
+        // since its result points into its str
+        std::map<std::string, std::vector<bool>> paramEscapes = {
+            {"len", {false}}, {"readFile", {false}}, {"lineEnd", {false, false}},
+            {"parseColumn", {false, false, false}}, {"openWriter", {false}}, {"write", {false, false}},
+            {"writeLine", {false, false}},
+        };
+
+        [[nodiscard]] bool argEscapes(const CallExpr &call, const size_t i) const {
+            const auto *callee = dynamic_cast<Identifier *>(call.function.get());
+            if (!callee) {
+                return true;
+            }
+            const auto it = paramEscapes.find(callee->value);
+            return it == paramEscapes.end() || i >= it->second.size() || it->second[i];
+        }
+
+        [[nodiscard]] bool usesEscape(Node *node, const std::string &name) const {
+            if (const auto *ident = dynamic_cast<Identifier *>(node)) {
+                return ident->value == name;
+            }
+            if (auto *call = dynamic_cast<CallExpr *>(node)) {
+                const auto *callee = dynamic_cast<Identifier *>(call->function.get());
+                if (!callee && usesEscape(call->function.get(), name)) {
+                    return true;
+                }
+                for (size_t i = 0; i < call->args.size(); i++) {
+                    const auto *arg = dynamic_cast<Identifier *>(call->args[i].get());
+                    if (arg && arg->value == name) {
+                        if (argEscapes(*call, i)) {
+                            return true;
+                        }
+                    } else if (usesEscape(call->args[i].get(), name)) {
+                        return true;
+                    }
+                }
+                return false;
+            }
+            if (auto *func = dynamic_cast<FuncLiteral *>(node)) {
+                // a param of the same name shadows it, any other mention is a capture
+                for (const auto &param: func->parameters) {
+                    if (param->value == name) {
+                        return false;
+                    }
+                }
+                return mentions(func->body.get(), name);
+            }
+            if (dynamic_cast<ExternStmt *>(node)) {
+                // its params only name c args
+                return false;
+            }
+            if (auto *decl = dynamic_cast<VarDeclStmt *>(node)) {
+                // the declared name is a binding, not a use
+                return decl->value && usesEscape(decl->value.get(), name);
+            }
+            if (auto *assign = dynamic_cast<AssignStmt *>(node)) {
+                // so is an assigned one, storing through an index only reads the array
+                return reads(assign->target.get(), name) || usesEscape(assign->value.get(), name);
+            }
+            if (auto *index = dynamic_cast<IndexExpr *>(node)) {
+                return reads(index->left.get(), name) || reads(index->index.get(), name);
+            }
+            if (auto *infix = dynamic_cast<InfixExpr *>(node)) {
+                return reads(infix->lhs.get(), name) || reads(infix->rhs.get(), name);
+            }
+
+            bool escapes = false;
+            forEachChild(node, [&](Node *child) {
+                escapes = escapes || usesEscape(child, name);
+            });
+            return escapes;
+        }
+
+        // a bare name in a read only position doesn't escape, anything around it still might
+        [[nodiscard]] bool reads(Node *node, const std::string &name) const {
+            return !dynamic_cast<Identifier *>(node) && usesEscape(node, name);
+        }
+
+        [[nodiscard]] static bool mentions(Node *node, const std::string &name) {
+            if (const auto *ident = dynamic_cast<Identifier *>(node)) {
+                return ident->value == name;
+            }
+            bool found = false;
+            forEachChild(node, [&](Node *child) {
+                found = found || mentions(child, name);
+            });
+            return found;
+        }
+
+        // params start out not escaping and flip once a use says otherwise.
+        // an async fnc's may be read after its caller has returned, on another
+        // thread, so they all escape
+        void solveParams() {
+            for (const auto &[name, func]: globals) {
+                paramEscapes[name].assign(func->parameters.size(), func->async);
+            }
+
+            bool changed = true;
+            while (changed) {
+                changed = false;
+                for (const auto &[name, func]: globals) {
+                    for (size_t i = 0; i < func->parameters.size(); i++) {
+                        if (!paramEscapes[name][i] && usesEscape(func->body.get(), func->parameters[i]->value)) {
+                            paramEscapes[name][i] = true;
+                            changed = true;
+                        }
+                    }
+                }
+            }
+        }
+
+        // one fnc at a time, calls to fncs solved earlier use their answer and
+        // calls to ones not seen yet escape
+        void solveParams(const FuncLiteral &func) {
+            std::vector<bool> &escapes = paramEscapes[func.name];
+            escapes.assign(func.parameters.size(), func.async);
+
+            bool changed = true;
+            while (changed) {
+                changed = false;
+                for (size_t i = 0; i < func.parameters.size(); i++) {
+                    if (!escapes[i] && usesEscape(func.body.get(), func.parameters[i]->value)) {
+                        escapes[i] = true;
+                        changed = true;
+                    }
+                }
+            }
+        }
+
+        // fnc literals, array literals and str concatenations are the values
+        // that get an environment or data of their own
+        static void setEscapes(Node *node, const bool escapes) {
+            if (auto *func = dynamic_cast<FuncLiteral *>(node)) {
+                func->escapes = escapes;
+            } else if (auto *array = dynamic_cast<ArrayLiteral *>(node)) {
+                array->escapes = escapes;
+            } else if (auto *infix = dynamic_cast<InfixExpr *>(node)) {
+                infix->escapes = escapes;
+            }
+        }
+
+        // scope is the block or program the value was bound in, null for a
+        // program whose later statements aren't known
+        void visit(Node *node, Node *scope) {
+            if (dynamic_cast<BlockStmt *>(node) || dynamic_cast<Program *>(node)) {
+                scope = node;
+            }
+
+            if (auto *call = dynamic_cast<CallExpr *>(node)) {
+                setEscapes(call->function.get(), false);
+                for (size_t i = 0; i < call->args.size(); i++) {
+                    setEscapes(call->args[i].get(), argEscapes(*call, i));
+                }
+            } else if (auto *decl = dynamic_cast<VarDeclStmt *>(node)) {
+                if (decl->value) {
+                    setEscapes(decl->value.get(), !scope || usesEscape(scope, decl->name->value));
+                }
+            } else if (auto *index = dynamic_cast<IndexExpr *>(node)) {
+                setEscapes(index->left.get(), false);
+            } else if (auto *infix = dynamic_cast<InfixExpr *>(node)) {
+                setEscapes(infix->lhs.get(), false);
+                setEscapes(infix->rhs.get(), false);
+            } else if (auto *stmt = dynamic_cast<ExprStmt *>(node)) {
+                // fnc name(...) {...} inside a body binds name like a decl
+                auto *func = dynamic_cast<FuncLiteral *>(stmt->expr.get());
+                if (func && !func->topLevel && !func->name.empty()) {
+                    func->escapes = !scope || usesEscape(scope, func->name);
+                }
+            }
+
+            forEachChild(node, [&](Node *child) {
+                visit(child, scope);
+            });
+        }
+
+        void declareExtern(const Stmt &stmt) {
+            if (const auto *ext = dynamic_cast<const ExternStmt *>(&stmt)) {
+                paramEscapes[ext->name].assign(ext->parameters.size(), false);
+            }
+        }
+
+    public:
+        void run(Program &program) {
+            for (const auto &stmt: program.stmts) {
+                declareExtern(*stmt);
+                const auto *exprStmt = dynamic_cast<ExprStmt *>(stmt.get());
+                auto *func = exprStmt ? dynamic_cast<FuncLiteral *>(exprStmt->expr.get()) : nullptr;
+                if (func && !func->name.empty()) {
+                    func->topLevel = true;
+                    globals[func->name] = func;
+                }
+            }
+            solveParams();
+            visit(&program, &program);
+        }
+
+        void runStmt(Stmt &stmt) {
+            declareExtern(stmt);
+            const auto *exprStmt = dynamic_cast<ExprStmt *>(&stmt);
+            auto *func = exprStmt ? dynamic_cast<FuncLiteral *>(exprStmt->expr.get()) : nullptr;
+            if (func && !func->name.empty()) {
+                func->topLevel = true;
+                solveParams(*func);
+            }
+            visit(&stmt, nullptr);
+        }
+    };
+
+    void analyzeEscapes(Program &program) {
+        EscapeAnalysis().run(program);
+    }
+
+    EscapeStream::EscapeStream() : analysis(std::make_unique<EscapeAnalysis>()) {
+    }
+
+    EscapeStream::~EscapeStream() = default;
+
+    void EscapeStream::add(Stmt &stmt) {
+        analysis->runStmt(stmt);
+    }
+} // cblt::sema
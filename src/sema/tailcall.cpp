@@ -0,0 +1,229 @@
+#include "../h/sema.h"
+#include <functional>
+#include <map>
+#include <set>
+
+using namespace cblt::ast;
+
+namespace cblt::sema {
+    // the spelling codegen gives one llvm type, a missing type is num and a
+    // plain fnc is fnc(num) -> num, at any depth
+    static std::string normalType(const std::string &type) {
+        if (type.empty()) {
+            return "num";
+        }
+        std::string out;
+        for (std::size_t i = 0; i < type.size();) {
+            if (type.compare(i, 3, "fnc") == 0 && (i + 3 == type.size() || type[i + 3] != '(')) {
+                out += "fnc(num) -> num";
+                i += 3;
+            } else {
+                out += type[i++];
+            }
+        }
+        return out;
+    }
+
+    static std::string paramType(const FuncLiteral &fnc, const std::size_t i) {
+        return normalType(i < fnc.paramTypes.size() ? fnc.paramTypes[i] : "");
+    }
+
+    // types whose values may point into a frame's region or stack, see holdsPointer in codegen.cpp
+    static bool holdsPointer(const std::string &type) {
+        return type == "str" || type == "[]num" || type.rfind("fnc(", 0) == 0;
+    }
+
+    // calls that are the operand of a return and names declared with decl,
+    // nested fncs excluded
+    static void scanBody(Node *node, std::vector<CallExpr *> &returned, std::set<std::string> &declared) {
+        if (dynamic_cast<FuncLiteral *>(node)) {
+            return;
+        }
+        if (const auto *ret = dynamic_cast<ReturnStmt *>(node)) {
+            if (auto *call = dynamic_cast<CallExpr *>(ret->returnValue.get())) {
+                returned.push_back(call);
+            }
+        }
+        if (const auto *decl = dynamic_cast<VarDeclStmt *>(node)) {
+            declared.insert(decl->name->value);
+        }
+        forEachChild(node, [&](Node *child) {
+            scanBody(child, returned, declared);
+        });
+    }
+
+    TailCall tailCallKind(FuncLiteral &caller, CallExpr &call, const FuncLiteral *callee) {
+        const auto *ident = dynamic_cast<Identifier *>(call.function.get());
+        if (!callee || !ident || caller.async || callee->async || call.args.size() != callee->parameters.size()) {
+            return TailCall::NONE;
+        }
+        std::vector<CallExpr *> returned;
+        std::set<std::string> declared, assigned;
+        scanBody(caller.body.get(), returned, declared);
+        collectAssigned(caller.body.get(), assigned);
+        std::set<std::string> params;
+        for (const auto &param: caller.parameters) {
+            params.insert(param->value);
+        }
+        // a param or local of the same name is a fnc value, not the top level fnc
+        if (params.count(ident->value) || declared.count(ident->value)) {
+            return TailCall::NONE;
+        }
+        if (callee->name == caller.name) {
+            return TailCall::LOOP;
+        }
+        if (!caller.topLevel || caller.parameters.size() != callee->parameters.size() ||
+            normalType(caller.returnType) != normalType(callee->returnType)) {
+            return TailCall::NONE;
+        }
+        for (std::size_t i = 0; i < caller.parameters.size(); i++) {
+            if (paramType(caller, i) != paramType(*callee, i)) {
+                return TailCall::NONE;
+            }
+        }
+
+        // params that only ever hold what the caller was called with. self
+        // recursion rebinds them, so it may bring in this frame's memory too
+        std::set<std::string> passed;
+        for (const auto &param: caller.parameters) {
+            if (!assigned.count(param->value) && !declared.count(param->value)) {
+                passed.insert(param->value);
+            }
+        }
+        const auto passesThrough = [&](Expr *arg, const std::string &type) {
+            if (!holdsPointer(type) || dynamic_cast<StringLiteral *>(arg)) {
+                return true;
+            }
+            const auto *name = dynamic_cast<Identifier *>(arg);
+            return name && passed.count(name->value) > 0;
+        };
+        for (bool changed = true; changed;) {
+            changed = false;
+            for (CallExpr *self: returned) {
+                const auto *selfName = dynamic_cast<Identifier *>(self->function.get());
+                if (!selfName || selfName->value != caller.name || self->args.size() != caller.parameters.size()) {
+                    continue;
+                }
+                for (std::size_t i = 0; i < self->args.size(); i++) {
+                    const std::string &param = caller.parameters[i]->value;
+                    if (passed.count(param) && !passesThrough(self->args[i].get(), paramType(caller, i))) {
+                        passed.erase(param);
+                        changed = true;
+                    }
+                }
+            }
+        }
+        for (std::size_t i = 0; i < call.args.size(); i++) {
+            if (!passesThrough(call.args[i].get(), paramType(*callee, i))) {
+                return TailCall::NONE;
+            }
+        }
+        return TailCall::MUSTTAIL;
+    }
+
+    TailRecursionCheck::TailRecursionCheck(const std::vector<FuncLiteral *> &fncs) {
+        for (const FuncLiteral *func: fncs) {
+            signatures[func->name] = func;
+        }
+    }
+
+    // calls made by a fnc body, nested fnc literals are their own functions
+    void TailRecursionCheck::collectCalls(FuncLiteral &caller, Node *node, const bool inTail,
+                                          std::vector<CallSite> &calls) {
+        if (dynamic_cast<FuncLiteral *>(node)) {
+            return;
+        }
+        if (auto *call = dynamic_cast<CallExpr *>(node)) {
+            if (const auto *ident = dynamic_cast<Identifier *>(call->function.get())) {
+                const auto it = signatures.find(ident->value);
+                const FuncLiteral *callee = it != signatures.end() ? it->second : nullptr;
+                const bool tail = inTail && tailCallKind(caller, *call, callee) != TailCall::NONE;
+                calls.push_back({ident->value, inTail, tail, call->token.line});
+            }
+            for (const auto &arg: call->args) {
+                collectCalls(caller, arg.get(), false, calls);
+            }
+            return;
+        }
+        if (auto *ret = dynamic_cast<ReturnStmt *>(node)) {
+            if (ret->returnValue) {
+                collectCalls(caller, ret->returnValue.get(), !caller.async, calls);
+            }
+            return;
+        }
+        forEachChild(node, [&](Node *child) {
+            collectCalls(caller, child, false, calls);
+        });
+    }
+
+    std::vector<std::string> checkTailRecursion(Program &program) {
+        std::vector<FuncLiteral *> fncs;
+        for (const auto &stmt: program.stmts) {
+            const auto *exprStmt = dynamic_cast<ExprStmt *>(stmt.get());
+            auto *func = exprStmt ? dynamic_cast<FuncLiteral *>(exprStmt->expr.get()) : nullptr;
+            if (func && !func->name.empty()) {
+                fncs.push_back(func);
+            }
+        }
+        TailRecursionCheck check(fncs);
+        for (const auto &stmt: program.stmts) {
+            check.add(*stmt);
+        }
+        return check.finish();
+    }
+
+    void TailRecursionCheck::add(Stmt &stmt) {
+        const auto *exprStmt = dynamic_cast<ExprStmt *>(&stmt);
+        auto *func = exprStmt ? dynamic_cast<FuncLiteral *>(exprStmt->expr.get()) : nullptr;
+        if (func && !func->name.empty()) {
+            // codegen marks it the same way before lowering it
+            func->topLevel = true;
+            collectCalls(*func, func->body.get(), false, graph[func->name]);
+        }
+    }
+
+    std::vector<std::string> TailRecursionCheck::finish() const {
+        // a call recurses when the callee can reach the caller again
+        const std::function<bool(const std::string &, const std::string &, std::set<std::string> &)> reaches =
+                [&](const std::string &from, const std::string &to, std::set<std::string> &seen) {
+            if (from == to) {
+                return true;
+            }
+            if (!seen.insert(from).second) {
+                return false;
+            }
+            const auto it = graph.find(from);
+            if (it == graph.end()) {
+                return false;
+            }
+            for (const auto &site: it->second) {
+                if (reaches(site.callee, to, seen)) {
+                    return true;
+                }
+            }
+            return false;
+        };
+
+        std::vector<std::string> warnings;
+        for (const auto &[caller, calls]: graph) {
+            for (const auto &site: calls) {
+                std::set<std::string> seen;
+                if (site.tail || !graph.count(site.callee) || !reaches(site.callee, caller, seen)) {
+                    continue;
+                }
+                const std::string where = " to " + site.callee + " in " + caller + ", line=" +
+                                          std::to_string(site.line);
+                if (!site.returned) {
+                    warnings.emplace_back("Warning: non-tail recursive call" + where +
+                                          "\nreturn the call directly to run in constant stack space");
+                } else {
+                    warnings.emplace_back("Warning: returned recursive call" + where + " keeps the caller's frame"
+                                          "\nin constant stack space the callee takes the caller's param and return"
+                                          " types, and str, []num and fnc args are literals or the caller's own"
+                                          " unassigned params");
+                }
+            }
+        }
+        return warnings;
+    }
+} // cblt::sema
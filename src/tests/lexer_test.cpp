@@ -3,7 +3,7 @@
 #include <iostream>
 #include <string>
 #include <vector>
-#include "../parser/lexer.cpp"
+#include "../h/lexer.h"
 
 void testLexer() {
     struct Expected {
@@ -22,6 +22,10 @@ void testLexer() {
         { cblt::lex::TokenType::CONTINUE, "continue", 1 },
         { cblt::lex::TokenType::TRUE,     "true", 1 },
         { cblt::lex::TokenType::FALSE,    "false", 1 },
+        { cblt::lex::TokenType::ASYNC,    "async", 1 },
+        { cblt::lex::TokenType::AWAIT,    "await", 1 },
+        { cblt::lex::TokenType::SPAWN,    "spawn", 1 },
+        { cblt::lex::TokenType::EXTERN,   "extern", 1 },
         { cblt::lex::TokenType::IDENT,  "foo", 1 },
         { cblt::lex::TokenType::NUM,    "123", 1 },
         { cblt::lex::TokenType::NUM,  "45.67", 1 },
@@ -61,7 +65,7 @@ void testLexer() {
         { cblt::lex::TokenType::EoF,      "", 5 }
     };
 
-    std::string input = R"(fnc if else while return break continue true false foo 123 45.67 =+-*/%!|&^.$->
+    std::string input = R"(fnc if else while return break continue true false async await spawn extern foo 123 45.67 =+-*/%!|&^.$->
 > < >= <= == != && || (){}[];:,"hello world"
 
 "rizz"
@@ -76,5 +80,20 @@ void testLexer() {
         assert(tok.line    == i.line    && "Token line mismatch");
     }
 
+    // the buffer holds the same tokens, with nums already decoded
+    cblt::lex::Lexer bl(input);
+    cblt::lex::TokenBuffer buf = bl.tokenize();
+    assert(buf.size() == expected.size() && "TokenBuffer size mismatch");
+    for (size_t i = 0; i < expected.size(); i++) {
+        assert(buf.kinds[i]  == expected[i].type    && "TokenBuffer kind mismatch");
+        assert(buf.text(i)   == expected[i].literal && "TokenBuffer text mismatch");
+        assert(buf.lines[i]  == expected[i].line    && "TokenBuffer line mismatch");
+    }
+    assert(buf.number(14) == 123 && buf.number(15) == 45.67 && "TokenBuffer num mismatch");
+
+    cblt::lex::Lexer bad("decl x -> 1.2.3;");
+    cblt::lex::TokenBuffer badBuf = bad.tokenize();
+    assert(badBuf.kinds[3] == cblt::lex::TokenType::ILLEGAL && !bad.getErrors().empty() && "expected a lex error");
+
     std::cout << "lexer tests pass\n";
 }
\ No newline at end of file
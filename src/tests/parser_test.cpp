@@ -0,0 +1,108 @@
+// parser_test.cpp
+#include <cassert>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+#include "../h/document.h"
+#include "../h/parser.h"
+
+void testParser() {
+    struct Expected {
+        std::string input;
+        std::string output;
+    };
+
+    std::vector<Expected> expected = {
+        { "decl x : num -> 5;", "decl x -> 5;" },
+        { "decl nums : []num;", "decl nums -> null;" },
+        { "return x;", "return x;" },
+        { "-a * b", "((-a) * b)" },
+        { "!true == false", "((!true) == false)" },
+        { "a + b * c - d / e", "((a + (b * c)) - (d / e))" },
+        { "3 > 5 == false", "((3 > 5) == false)" },
+        { "x <= (1 + 2) * 3", "(x <= ((1 + 2) * 3))" },
+        { "add(a, b * c)[0]", "(add(a, (b * c))[0])" },
+        { "if x < y { x } else { y }", "if (x < y) {x } else {y }" },
+        { "fnc add(a: num, b: num) -> num { return a + b; }", "fnc add(a: num, b: num) -> num {return (a + b); }" },
+        { "// comment\ndecl s : str -> \"hi\";", "decl s -> \"hi\";" },
+        { "decl m : {str: num} -> {\"a\": 1, \"b\": 2 + 3};", "decl m -> {\"a\": 1, \"b\": (2 + 3)};" },
+        { "m[\"a\"] + {1: 2}[1]", "((m[\"a\"]) + ({1: 2}[1]))" },
+        { "a || b && c == d", "(a || (b && (c == d)))" },
+        { "while i < n { i = i + 1; xs[i] = 0; }", "while (i < n) {i = (i + 1); (xs[i]) = 0; }" },
+        { "async fnc f(t: task) -> num { return await t + 1; }", "async fnc f(t: task) -> num {return ((await t) + 1); }" },
+        { "decl t : task -> spawn f(x);", "decl t -> (spawn f(x));" },
+        { "fnc apply(f: fnc(num, str) -> bool, x: num) -> fnc(num) -> num { f }",
+          "fnc apply(f: fnc(num, str) -> bool, x: num) -> fnc(num) -> num {f }" },
+        { "extern pure fnc hypot(x: num, y: num) -> num; extern fnc fill(xs: []num, v: num)",
+          "extern pure fnc hypot(x: num, y: num) -> num; extern fnc fill(xs: []num, v: num);" },
+    };
+
+    for (auto &i : expected) {
+        cblt::lex::Lexer l(i.input);
+        cblt::parse::Parser p(l);
+        auto program = p.parseProgram();
+        std::cout << program->String() << '\n';
+        assert(p.getErrors().empty() && "unexpected parse errors");
+        assert(program->String() == i.output && "Program string mismatch");
+    }
+
+    cblt::lex::Lexer l("decl -> 5;");
+    cblt::parse::Parser p(l);
+    p.parseProgram();
+    assert(!p.getErrors().empty() && "expected a parse error");
+
+    // the outline of a file, then its statements one at a time with the parsed tokens freed
+    cblt::lex::Lexer sl("decl x : num -> 1; ; x = x + 2; fnc f() { x } async fnc g(a: num) -> num { a }\n"
+                        "decl h : fnc -> fnc k(y: num) -> num { y = 1; y }; fnc m() { 1 }(2);");
+    cblt::parse::Parser sp(sl);
+    const auto outline = sp.outline();
+    assert(outline.fncs.size() == 2 && outline.fncs[0]->name == "f" && !outline.fncs[0]->async &&
+           outline.fncs[1]->name == "g" && outline.fncs[1]->async && outline.fncs[1]->returnType == "num" &&
+           !outline.fncs[1]->body && "outline fncs mismatch");
+    assert(outline.assigned == std::set<std::string>({"x", "y"}) && "outline assigned mismatch");
+    std::vector<std::string> stmts;
+    while (auto stmt = sp.parseNext()) {
+        sp.dropParsed();
+        stmts.push_back(stmt->String());
+    }
+    assert(stmts.size() == 6 && stmts[1] == "x = (x + 2);" && "parseNext mismatch");
+    assert(sp.getErrors().empty() && "unexpected parse errors");
+
+    // edits to a Document read the same as parsing the edited text from scratch
+    struct Edit {
+        std::size_t offset, removed;
+        std::string inserted;
+    };
+    std::string text = "decl a : num -> 1;\nfnc f(x: num) -> num {\n    return x * 2;\n}\ndecl b : num -> f(a);\n";
+    cblt::parse::Document doc(text);
+    for (const auto &[offset, removed, inserted]: std::vector<Edit>{
+             {16, 1, "42"}, // inside a num
+             {0, 0, "\n\n"}, // lines move for everything after
+             {23, 0, "decl s : str -> \""}, // an open str runs to the end
+             {std::string::npos, 0, "\";"}, // closes it, at the end
+             {26, 4, ""}, // fnc -> f, the statement it starts changes
+             {5, 1, "1.2.3"}, // lex error
+         }) {
+        const std::size_t at = std::min(offset, text.size());
+        text.replace(at, removed, inserted);
+        assert(doc.edit(at, removed, inserted) && "edit out of range");
+
+        cblt::lex::Lexer fl(text);
+        cblt::parse::Parser fp(fl);
+        auto full = fp.parseProgram();
+        std::vector<std::string> diag = fl.getErrors();
+        for (const std::string &err: fp.getErrors()) {
+            diag.push_back(err);
+        }
+        cblt::ast::Program &prog = doc.program();
+        assert(doc.text() == text && prog.String() == full->String() && "document ast mismatch");
+        assert(doc.diagnostics() == diag && "document diagnostics mismatch");
+        for (std::size_t i = 0; i < full->stmts.size(); i++) {
+            assert(prog.stmts[i]->TokenLine() == full->stmts[i]->TokenLine() && "document line mismatch");
+        }
+    }
+    assert(!doc.edit(text.size() + 1, 0, "x") && "edit past the end");
+
+    std::cout << "parser tests pass\n";
+}